@@ -0,0 +1,101 @@
+#include "arena.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+namespace jsonutil {
+namespace {
+const size_t kAlign = 8;
+const size_t kMaxBlockSize = 1 << 20;
+
+inline size_t AlignUp(size_t n) {
+  return (n + kAlign - 1) & ~(kAlign - 1);
+}
+} // static-function namespace
+
+void* Arena::Allocate(int size) {
+  assert(size >= 0);
+  size_t bytes = AlignUp(size > 0 ? static_cast<size_t>(size) : 1);
+  if (bytes > static_cast<size_t>(end_ - ptr_)) {
+    return AllocateSlow(bytes);
+  }
+  void* ret = ptr_;
+  ptr_ += bytes;
+  usage_ += bytes;
+  return ret;
+}
+
+void* Arena::AllocateSlow(size_t size) {
+  size_t header = AlignUp(sizeof(Block));
+  size_t block_size = JSONUTIL_ARENA_BLOCK_SIZE;
+  if (head_ && head_->size < kMaxBlockSize) {
+    block_size = head_->size << 1;
+  } else if (head_) {
+    block_size = head_->size;
+  }
+  bool dedicated = size > block_size / 4;
+  if (dedicated) block_size = size;
+
+  Block* b = static_cast<Block*>(malloc(header + block_size));
+  if (b == NULL) return NULL;
+  b->size = block_size;
+  char* data = reinterpret_cast<char*>(b) + header;
+  usage_ += size;
+  if (dedicated && head_) {
+    /* Keep bumping in the current block; big chunks live behind it. */
+    b->next = head_->next;
+    head_->next = b;
+    return data;
+  }
+  b->next = head_;
+  head_ = b;
+  ptr_ = data + size;
+  end_ = data + block_size;
+  return data;
+}
+
+void Arena::Reset() {
+  if (head_ == NULL) return;
+  Block* p = head_->next;
+  while (p) {
+    Block* next = p->next;
+    free(p);
+    p = next;
+  }
+  head_->next = NULL;
+  ptr_ = reinterpret_cast<char*>(head_) + AlignUp(sizeof(Block));
+  end_ = ptr_ + head_->size;
+  usage_ = 0;
+}
+
+void Arena::Adopt(Arena& other) {
+  if (other.head_ == NULL || &other == this) return;
+  if (head_ == NULL) {
+    head_ = other.head_;
+    ptr_ = other.ptr_;
+    end_ = other.end_;
+  } else {
+    /* Keep bumping in the current block; the adopted ones go behind it. */
+    Block* tail = other.head_;
+    while (tail->next) tail = tail->next;
+    tail->next = head_->next;
+    head_->next = other.head_;
+  }
+  usage_ += other.usage_;
+  other.head_ = NULL;
+  other.ptr_ = other.end_ = NULL;
+  other.usage_ = 0;
+}
+
+void Arena::Free() {
+  Block* p = head_;
+  while (p) {
+    Block* next = p->next;
+    free(p);
+    p = next;
+  }
+  head_ = NULL;
+  ptr_ = end_ = NULL;
+  usage_ = 0;
+}
+} // namespace jsonutil
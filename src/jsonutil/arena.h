@@ -0,0 +1,50 @@
+#ifndef JSONUTIL_SRC_ARENA_H__
+#define JSONUTIL_SRC_ARENA_H__
+
+#include <stddef.h>
+
+#ifndef JSONUTIL_ARENA_BLOCK_SIZE
+  #define JSONUTIL_ARENA_BLOCK_SIZE 4096
+#endif
+
+namespace jsonutil {
+/* Bump-pointer allocator. There is no per-allocation free: everything handed
+ * out by Allocate() is released at once by Reset() or the destructor. */
+class Arena {
+ public:
+  Arena() : head_(NULL), ptr_(NULL), end_(NULL), usage_(0) {
+  }
+
+  ~Arena() {
+    Free();
+  }
+  /* Returns 8-byte aligned memory, or NULL when out of memory. */
+  void* Allocate(int size);
+  /* Drop all allocations but keep the current block for reuse. */
+  void Reset();
+  void Free();
+  /* Take over the blocks of @other, which is left empty: what it handed
+   * out is now released along with this arena's allocations. */
+  void Adopt(Arena& other);
+  /* Bytes handed out since the last Reset(). */
+  size_t Usage() const { return usage_; }
+
+ private:
+  /* Arena is noncopyable. */
+  Arena(const Arena&);
+  const Arena& operator=(const Arena&);
+
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+  void* AllocateSlow(size_t size);
+
+  Block* head_;
+  char* ptr_;
+  char* end_;
+  size_t usage_;
+};
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_ARENA_H__
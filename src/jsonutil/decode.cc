@@ -0,0 +1,208 @@
+#include "decode.h"
+#include "simd.h"
+
+#include <string.h>
+
+namespace jsonutil {
+namespace {
+
+JsonStatus TranslateHex(Slice& s, uint16_t& buf) {
+#pragma GCC diagnostic ignored "-Wconversion"
+  if (s.Len() < 4) return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_HEX;
+  buf = 0;
+  for (int i = 0; i < 4; ++i) {
+    char chr = *s.Ptr();
+    if (chr >= '0' && chr <= '9') {
+      chr = (chr - '0');
+    } else if (chr >= 'a' && chr <= 'f') {
+      chr = (chr - 'a' + 10);
+    } else if (chr >= 'A' && chr <= 'F') {
+      chr = (chr - 'A' + 10);
+    } else {
+      return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_HEX;
+    }
+    buf <<= 4;
+    buf |= 0x0F & chr;
+    s.Move(1);
+  }  
+#pragma GCC diagnostic error "-Wconversion"
+  return JsonStatus::kJSON_OK;
+}
+
+JsonStatus EncodeByUTF8(uint32_t& buf, char& num) {
+  uint32_t ret = 0;
+  if (buf <= 0x7F) {
+    num = 1;
+    ret = buf;
+  } else if (buf <= 0x7FF) {
+    num = 2;
+    ret = (0xC0 | ((buf >> 6) & 0x1F)) << 8;
+    ret |= 0x80 | ( buf       & 0x3F);
+  } else if (buf <= 0xFFFF) {
+    num = 3;
+    ret =  (0xE0 | ((buf >> 12) & 0x0F)) << 16;
+    ret |= (0x80 | ((buf >> 6 ) & 0x3F)) <<  8;
+    ret |= (0x80 | ( buf        & 0x3F));
+  } else if (buf <= 0x10FFFF) {
+    num = 4;
+    ret =  (0xF0 | ((buf >> 18) & 0x07)) << 24;
+    ret |= (0x80 | ((buf >> 12) & 0x3F)) << 16;
+    ret |= (0x80 | ((buf >>  6) & 0x3F)) <<  8;
+    ret |= (0x80 | ( buf        & 0x3F));
+  } else {
+    return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_RANGE;
+  }
+  buf = ret;
+  return JsonStatus::kJSON_OK;
+}
+
+JsonStatus TranslateUnicodeHex(Slice& s, uint32_t& buf, char& num) {
+  if (s.Len() == 0) return JsonStatus::kJSON_PARSE_STRING_ESCAPED_INVALID_CHAR;
+  uint16_t high = 0, low = 0;
+  JsonStatus ret = TranslateHex(s, high);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  if (high >= 0xD800 && high <= 0xDBFF) {
+    /* Only the escape is checked here: TranslateHex reports short or bad
+     * hex the same way whatever bytes follow the string. */
+    if (s.Len() < 2 || !(s.Ptr()[0] == '\\' && s.Ptr()[1] == 'u')) {
+      return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_SURROGATE;      
+    }
+    s.Move(2);
+    ret =  TranslateHex(s, low);
+    if (ret != JsonStatus::kJSON_OK) return ret;
+    if (low < 0xDC00 || low > 0xDFFF) {
+      return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_SURROGATE;
+    }
+    buf = 0x10000 + (high - 0xD800) * 0x400 + (low - 0xDC00);
+  } else if (high >= 0xDC00 && high <= 0xDFFF) {
+    return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_SURROGATE; 
+  } else {
+    buf = high;
+  }
+  return EncodeByUTF8(buf, num);
+}
+
+JsonStatus TranslateEscapedChar(Slice& s, uint32_t& buf, char& num) {
+  if (s.Len() == 0) return JsonStatus::kJSON_PARSE_STRING_ESCAPED_INVALID_CHAR;
+  char chr = *s.Ptr();
+  s.Move(1);
+  num = 1;
+  switch (chr) {
+    case '\\':  buf = '\\'; break;
+    case '\"':  buf = '\"'; break;
+    case '/':   buf = '/';  break;
+    case 'b':   buf = '\b'; break;
+    case 'f':   buf = '\f'; break;
+    case 'n':   buf = '\n'; break;
+    case 'r':   buf = '\r'; break;
+    case 't':   buf = '\t'; break;
+    case 'u':   return TranslateUnicodeHex(s, buf, num);
+    default:    return JsonStatus::kJSON_PARSE_STRING_ESCAPED_INVALID_CHAR;
+  }
+  return JsonStatus::kJSON_OK;
+}
+
+inline void WriteUint32(char* dst, uint32_t u, int bytes) {
+  while (--bytes >= 0) {
+    *dst++ = static_cast<char>((u >> (8 * bytes)) & 0xFF);  // big endian
+  }
+}
+
+} // static-function namespace
+
+JsonStatus ParseStringInStack(Stack& stk, Slice& s, int& len) {
+  s.Move(1); // +1 skip the leading mark '"' 
+  int head = stk.Top();
+  JsonStatus ret;
+  uint32_t buf;
+  char num = 0;
+  while (true) {
+    /* Bulk-copy the run of bytes that need no decoding. */
+    const char* run = s.Ptr();
+    int n = static_cast<int>(ScanStringRun(run, run + s.Len()) - run);
+    if (n > 0) {
+      stk.PushString(run, n);
+      s.Move(n);
+    }
+    if (s.Len() == 0) return JsonStatus::kJSON_PARSE_STRING_NO_END_MARK;
+    buf = *s.Ptr();
+    s.Move(1);
+    switch (buf) {
+      case '\"': len = stk.Top() - head;
+                 return JsonStatus::kJSON_OK;
+      case '\\': buf = 0;
+                 ret = TranslateEscapedChar(s, buf, num);
+                 if (ret != JsonStatus::kJSON_OK) return ret;
+                 stk.PushUint32(buf, num);
+                 break;
+      default:   return JsonStatus::kJSON_PARSE_STRING_INVALID_CHAR;
+    }
+  }
+  return JsonStatus::kJSON_OK; // never get here.
+}
+
+/* Escapes never expand, so the write cursor can't overtake the read cursor. */
+JsonStatus ParseStringInsitu(Slice& s, char*& str, int& len) {
+  s.Move(1); // +1 skip the leading mark '"' 
+  char* head = const_cast<char*>(s.Ptr());
+  char* dst = head;
+  JsonStatus ret;
+  uint32_t buf;
+  char num = 0;
+  while (true) {
+    const char* run = s.Ptr();
+    int n = static_cast<int>(ScanStringRun(run, run + s.Len()) - run);
+    if (n > 0) {
+      if (dst != run) memmove(dst, run, n);
+      dst += n;
+      s.Move(n);
+    }
+    if (s.Len() == 0) return JsonStatus::kJSON_PARSE_STRING_NO_END_MARK;
+    buf = *s.Ptr();
+    s.Move(1);
+    switch (buf) {
+      case '\"': len = static_cast<int>(dst - head);
+                 *dst = '\0';
+                 str = head;
+                 return JsonStatus::kJSON_OK;
+      case '\\': buf = 0;
+                 ret = TranslateEscapedChar(s, buf, num);
+                 if (ret != JsonStatus::kJSON_OK) return ret;
+                 WriteUint32(dst, buf, num);
+                 dst += num;
+                 break;
+      default:   return JsonStatus::kJSON_PARSE_STRING_INVALID_CHAR;
+    }
+  }
+  return JsonStatus::kJSON_OK; // never get here.
+}
+
+JsonStatus SkipString(Slice& s) {
+  s.Move(1); // +1 skip the leading mark '"'
+  JsonStatus ret;
+  uint32_t buf;
+  char num = 0;
+  while (true) {
+    const char* run = s.Ptr();
+    s.Move(static_cast<int>(ScanStringRun(run, run + s.Len()) - run));
+    if (s.Len() == 0) return JsonStatus::kJSON_PARSE_STRING_NO_END_MARK;
+    char c = *s.Ptr();
+    s.Move(1);
+    switch (c) {
+      case '\"': return JsonStatus::kJSON_OK;
+      case '\\': ret = TranslateEscapedChar(s, buf, num);
+                 if (ret != JsonStatus::kJSON_OK) return ret;
+                 break;
+      default:   return JsonStatus::kJSON_PARSE_STRING_INVALID_CHAR;
+    }
+  }
+  return JsonStatus::kJSON_OK; // never get here.
+}
+
+int ScanPlainString(const Slice& s) {
+  const char* p = s.Ptr() + 1;
+  const char* end = s.Ptr() + s.Len();
+  const char* q = ScanStringRun(p, end);
+  return (q < end && *q == '\"') ? static_cast<int>(q - p) : -1;
+}
+} // namespace jsonutil
@@ -0,0 +1,29 @@
+#ifndef JSONUTIL_SRC_DECODE_H__
+#define JSONUTIL_SRC_DECODE_H__
+
+#include "stack.h"
+#include "slice.h"
+#include "json_status.h"
+
+namespace jsonutil {
+/* String decoding shared by the DOM parser and the Reader. Each function
+ * expects @s to start at the leading mark '"' and on success leaves it just
+ * past the closing one. */
+
+/* Unescapes the string onto @stk; the @len decoded bytes are the top of it. */
+JsonStatus ParseStringInStack(Stack& stk, Slice& s, int& len);
+
+/* Decodes the string in place: the unescaped bytes are written back over the
+ * input right after the opening mark and terminated with '\0'. */
+JsonStatus ParseStringInsitu(Slice& s, char*& str, int& len);
+
+/* Checks the string as the functions above would decode it, without
+ * writing anything. */
+JsonStatus SkipString(Slice& s);
+
+/* Returns the length of the string if it has no escapes, or -1 when it has
+ * to be decoded (or is malformed). @s is not advanced. */
+int ScanPlainString(const Slice& s);
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_DECODE_H__
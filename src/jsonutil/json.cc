@@ -1,255 +1,379 @@
 #include "json.h"
+#include "simd.h"
+#include "number.h"
+#include "decode.h"
+#include "structural.h"
+#include "string_pool.h"
+#include "writer.h"
 
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
-#include <errno.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <limits.h>
+
+#include <thread>
+#include <vector>
 
 namespace jsonutil {
+
+/* State shared by the recursive Parse* helpers during one Parse() call. */
+struct ParseState {
+  ParseState(Stack& s, Arena* a, int f = kPARSE_DEFAULT, bool in = false) 
+    : stk(s), index(NULL), ctx(NULL), arena(a), flags(f), insitu(in) {
+  }
+
+  Stack& stk;
+  Stack* index;      /* reused for the structural index, or NULL */
+  ParseContext* ctx; /* its string pool, if any, interns keys and short strings */
+  Arena* arena; /* NULL: nodes are malloc'd and owned by the tree. */
+  int flags;    /* ParseFlag bits. */
+  bool insitu;  /* Strings are decoded inside the (mutable) input. */
+};
+
 namespace {
 
-/*=============================Parser Static functions=====================*/
+/* Nodes come from @arena when parsing into a Document, else from the heap. */
+inline void* Allocate(int size, Arena* arena = NULL) {
+  return arena ? arena->Allocate(size) : malloc(size);
+}
 
-bool IsSpace(const char* p) {
-  return (*p == ' ' || *p == '\t' 
-          || *p == '\r' || *p == '\n' || *p == '\0');
+inline char* CopyWithNull(const char* k, int len, Arena* arena = NULL) {
+  char* p = static_cast<char*>(Allocate(len + 1, arena));
+  if (p) {
+    if (len > 0) memcpy(p, k, len);
+    p[len] = '\0';
+  }
+  return p;
 }
 
-void SkipSpace(Slice& s) {
-  while (IsSpace(s.Ptr()) && s.Len() > 0) {
-    s.Move(1);
+inline void* MallocWithClear(int size, Arena* arena = NULL) {
+  void* p = Allocate(size, arena);
+  if (p) memset(p, 0, size);
+  return p;
+}
+
+/* The hash index of a large object sits right behind its member block: a
+ * mask, then a power-of-two table probed linearly. A used slot holds the
+ * member's position plus one in its low 24 bits and the top byte of the
+ * key's hash above, so that most probes are rejected without touching the
+ * member; 0 marks a free slot. Whether an object has an index follows from
+ * its size alone, so every path that builds a member block must call
+ * IndexMembers() once the members are in place. */
+const int kINDEX_POS_BITS = 24;
+
+int IndexSlots(int num) {
+  if (num < JSONUTIL_OBJECT_INDEX_MIN || num >= (1 << kINDEX_POS_BITS)) return 0;
+  int slots = 1;
+  while (slots < 2 * num) slots <<= 1;
+  return slots;
+}
+
+int MemberBlockBytes(int num) {
+  int slots = IndexSlots(num);
+  int bytes = num * static_cast<int>(sizeof(Member));
+  return slots ? bytes + (slots + 1) * static_cast<int>(sizeof(uint32_t)) : bytes;
+}
+
+inline uint32_t HashKey(const char* k, int len) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (int i = 0; i < len; ++i) {
+    h = (h ^ static_cast<unsigned char>(k[i])) * 16777619u;
   }
+  return h;
 }
 
-bool CheckSingular(Slice& s) {
-  SkipSpace(s);
-  return s.Len() == 0; 
+inline uint32_t HashTag(uint32_t hash) {
+  return hash >> kINDEX_POS_BITS << kINDEX_POS_BITS;
 }
 
-const char* IsInvalidNumber(Slice& s) {
-  typedef enum {
-    kINVALID = 0,
-    kMINUS,
-    kZERO, 
-    kONE_TO_NINE,
-    kDOT,
-    kEXPONENT,
-    kPLUS
-  } CharType;
-  
-  // construct the finite state machine according to the "Figure 4 - numbers" in 
-  // http://www.ecma-international.org/publications/files/ECMA-ST/ECMA-404.pdf
-  const char state_table[][7] = {
-    // 'invalid'  '-'    '0'   '1-9'    '.'  'e or E'    '+'
-           -1,     1,     2,     3,     -1,     -1,      -1, // initiate state 0
-           -1,    -1,     2,     3,     -1,     -1,      -1, // state 1
-           -1,    -1,    -1,    -1,      5,      7,      -1, // state 2
-           -1,    -1,     4,     4,      5,      7,      -1, // state 3
-           -1,    -1,     4,     4,      5,      7,      -1, // state 4
-           -1,    -1,     6,     6,     -1,      7,      -1, // state 5
-           -1,    -1,     6,     6,     -1,      7,      -1, // state 6
-           -1,     8,     9,     9,     -1,     -1,       8, // state 7
-           -1,    -1,     9,     9,     -1,     -1,      -1, // state 8
-           -1,    -1,     9,     9,     -1,     -1,      -1  // state 9
-  };
-  
-  int state = 0;
-  const char* ret = s.Ptr();
-  const char* p;
-  while (s.Len() > 0 && *s.Ptr() != ',' 
-         && *s.Ptr() != ']' && !IsSpace(s.Ptr())) {
-    CharType c = kINVALID;
-    p = s.Ptr();
-    if (*p == '0') {
-      c = kZERO;
-    } else if (*p >= '1' && *p <= '9') {
-      c = kONE_TO_NINE;
-    } else if (*p == '.') {
-      c = kDOT;
-    } else if (*p == 'e' || *p == 'E') {
-      c = kEXPONENT;
-    } else if (*p == '-') {
-      c = kMINUS;
-    } else if (*p == '+') {
-      c = kPLUS;
-    }
-    state = state_table[state][c];
-    if (state == -1) {
-      return NULL;
+/* Lengths first, then the prefix word, then the rest of the bytes. */
+inline bool SameKey(const Member& m, const Key& key) {
+  int len = key.Len();
+  if (m.KLen() != len) return false;
+  if (m.Key() == key.Ptr()) return true; // e.g. both from a StringPool
+  if (len < 8) return len == 0 || memcmp(m.Key(), key.Ptr(), len) == 0;
+  uint64_t head;
+  memcpy(&head, m.Key(), sizeof(head));
+  return head == key.Prefix() && memcmp(m.Key() + 8, key.Ptr() + 8, len - 8) == 0;
+}
+
+void IndexMembers(Member* m, int num) {
+  int slots = IndexSlots(num);
+  if (slots == 0) return;
+  uint32_t* t = reinterpret_cast<uint32_t*>(m + num);
+  uint32_t mask = static_cast<uint32_t>(slots - 1);
+  uint32_t pos_mask = (1u << kINDEX_POS_BITS) - 1;
+  t[0] = mask;
+  memset(t + 1, 0, slots * sizeof(uint32_t));
+  for (int i = 0; i < num; ++i) {
+    Key key(m[i].Key(), m[i].KLen());
+    uint32_t tag = HashTag(key.Hash());
+    uint32_t h = key.Hash() & mask;
+    /* Of duplicate keys the last one wins, as with the binary search. */
+    for (; t[h + 1]; h = (h + 1) & mask) {
+      if ((t[h + 1] & ~pos_mask) == tag && SameKey(m[(t[h + 1] & pos_mask) - 1], key)) break;
     }
-    s.Move(1);
+    t[h + 1] = tag | static_cast<uint32_t>(i + 1);
   }
-  if (state != 0 && state != 1) {
-    return ret;
+}
+
+const Member* FindIndexedMember(const Member* m, int num, const Key& key) {
+  const uint32_t* t = reinterpret_cast<const uint32_t*>(m + num);
+  uint32_t mask = t[0];
+  uint32_t pos_mask = (1u << kINDEX_POS_BITS) - 1;
+  uint32_t tag = HashTag(key.Hash());
+  for (uint32_t h = key.Hash() & mask; t[h + 1]; h = (h + 1) & mask) {
+    if ((t[h + 1] & ~pos_mask) != tag) continue;
+    const Member* p = m + (t[h + 1] & pos_mask) - 1;
+    if (SameKey(*p, key)) return p;
   }
   return NULL;
 }
 
-JsonStatus TranslateHex(Slice& s, uint16_t& buf) {
-#pragma GCC diagnostic ignored "-Wconversion"
-  if (s.Len() < 4) return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_HEX;
-  buf = 0;
-  for (int i = 0; i < 4; ++i) {
-    char chr = *s.Ptr();
-    if (chr >= '0' && chr <= '9') {
-      chr = (chr - '0');
-    } else if (chr >= 'a' && chr <= 'f') {
-      chr = (chr - 'a' + 10);
-    } else if (chr >= 'A' && chr <= 'F') {
-      chr = (chr - 'A' + 10);
-    } else {
-      return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_HEX;
-    }
-    buf <<= 4;
-    buf |= 0x0F & chr;
-    s.Move(1);
-  }  
-#pragma GCC diagnostic error "-Wconversion"
-  return JsonStatus::kJSON_OK;
+/*=============================Parser Static functions=====================*/
+
+void SkipSpace(Slice& s) {
+  const char* p = SkipWhitespace(s.Ptr(), s.Ptr() + s.Len());
+  s.Move(static_cast<int>(p - s.Ptr()));
 }
 
-JsonStatus EncodeByUTF8(uint32_t& buf, char& num) {
-  uint32_t ret = 0;
-  if (buf <= 0x7F) {
-    num = 1;
-    ret = buf;
-  } else if (buf <= 0x7FF) {
-    num = 2;
-    ret = (0xC0 | ((buf >> 6) & 0x1F)) << 8;
-    ret |= 0x80 | ( buf       & 0x3F);
-  } else if (buf <= 0xFFFF) {
-    num = 3;
-    ret =  (0xE0 | ((buf >> 12) & 0x0F)) << 16;
-    ret |= (0x80 | ((buf >> 6 ) & 0x3F)) <<  8;
-    ret |= (0x80 | ( buf        & 0x3F));
-  } else if (buf <= 0x10FFFF) {
-    num = 4;
-    ret =  (0xF0 | ((buf >> 18) & 0x07)) << 24;
-    ret |= (0x80 | ((buf >> 12) & 0x3F)) << 16;
-    ret |= (0x80 | ((buf >>  6) & 0x3F)) <<  8;
-    ret |= (0x80 | ( buf        & 0x3F));
-  } else {
-    return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_RANGE;
-  }
-  buf = ret;
-  return JsonStatus::kJSON_OK;
+bool CheckSingular(Slice& s) {
+  SkipSpace(s);
+  return s.Len() == 0; 
 }
 
-JsonStatus TranslateUnicodeHex(Slice& s, uint32_t& buf, char& num) {
-  if (s.Len() == 0) return JsonStatus::kJSON_PARSE_STRING_ESCAPED_INVALID_CHAR;
-  uint16_t high = 0, low = 0;
-  JsonStatus ret = TranslateHex(s, high);
-  if (ret != JsonStatus::kJSON_OK) return ret;
-  if (high >= 0xD800 && high <= 0xDBFF) {
-    if (s.Len() < 6 || !(s.Ptr()[0] == '\\' && s.Ptr()[1] == 'u')) {
-      return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_SURROGATE;      
-    }
-    s.Move(2);
-    ret =  TranslateHex(s, low);
-    if (ret != JsonStatus::kJSON_OK) return ret;
-    if (low < 0xDC00 || low > 0xDFFF) {
-      return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_SURROGATE;
-    }
-    buf = 0x10000 + (high - 0xD800) * 0x400 + (low - 0xDC00);
-  } else if (high >= 0xDC00 && high <= 0xDFFF) {
-    return JsonStatus::kJSON_PARSE_STRING_UNICODE_INVALID_SURROGATE; 
-  } else {
-    buf = high;
-  }
-  return EncodeByUTF8(buf, num);
-}
-
-JsonStatus TranslateEscapedChar(Slice& s, uint32_t& buf, char& num) {
-  if (s.Len() == 0) return JsonStatus::kJSON_PARSE_STRING_ESCAPED_INVALID_CHAR;
-  char chr = *s.Ptr();
-  s.Move(1);
-  num = 1;
-  switch (chr) {
-    case '\\':  buf = '\\'; break;
-    case '\"':  buf = '\"'; break;
-    case '/':   buf = '/';  break;
-    case 'b':   buf = '\b'; break;
-    case 'f':   buf = '\f'; break;
-    case 'n':   buf = '\n'; break;
-    case 'r':   buf = '\r'; break;
-    case 't':   buf = '\t'; break;
-    case 'u':   return TranslateUnicodeHex(s, buf, num);
-    default:    return JsonStatus::kJSON_PARSE_STRING_ESCAPED_INVALID_CHAR;
+/* Bytes that stage 1 ends a number or literal run at. */
+inline bool EndsScalarRun(char c) {
+  switch (c) {
+    case ' ':  case '\t': case '\r': case '\n': case '\0':
+    case '{':  case '}':  case '[':  case ']':  case ':':  case ',':
+    case '\"': return true;
+    default:   return false;
   }
-  return JsonStatus::kJSON_OK;
 }
 
-JsonStatus ParseStringInStack(Stack& stk, Slice& s, int& len) {
-  s.Move(1); // +1 skip the leading mark '"' 
-  int head = stk.Top();
-  JsonStatus ret;
-  uint32_t buf;
-  char num = 0;
-  while (true) {
-    if (s.Len() == 0) return JsonStatus::kJSON_PARSE_STRING_NO_END_MARK;
-    buf = *s.Ptr();
-    s.Move(1);
-    switch (buf) {
-      case '\"': len = stk.Top() - head;
-                 return JsonStatus::kJSON_OK;
-      case '\\': buf = 0;
-                 ret = TranslateEscapedChar(s, buf, num);
-                 if (ret != JsonStatus::kJSON_OK) return ret;
-                 stk.PushUint32(buf, num);
-                 break;
-      default:   if ((buf & 0xFF) < 0x20) {
-                   return JsonStatus::kJSON_PARSE_STRING_INVALID_CHAR;
-                 }
-                 stk.PushUint32(buf, 1);
+/* Parse a string into memory the tree can keep: the input itself for insitu
+ * and zero-copy parsing, else the string pool or a fresh copy. @owned tells
+ * whether the caller must free it. */
+JsonStatus ParseStringForTree(ParseState& ps, Slice& s, bool key,
+                              char*& str, int& len, bool& owned,
+                              char* small = NULL, int small_max = 0) {
+  owned = false;
+  if (ps.insitu) return ParseStringInsitu(s, str, len);
+  if (ps.flags & kPARSE_ZERO_COPY) {
+    len = ScanPlainString(s);
+    if (len >= 0) {
+      str = const_cast<char*>(s.Ptr() + 1);
+      s.Move(len + 2);
+      return JsonStatus::kJSON_OK;
     }
   }
-  return JsonStatus::kJSON_OK; // never get here.
+  JsonStatus ret = ParseStringInStack(ps.stk, s, len);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  const char* bytes = ps.stk.Pop(len);
+  if (small && len <= small_max) {
+    /* Short enough for the caller's own buffer @small. */
+    if (len > 0) memcpy(small, bytes, len);
+    small[len] = '\0';
+    str = small;
+    return ret;
+  }
+  StringPool* pool = ps.ctx ? ps.ctx->GetStringPool() : NULL;
+  if (pool && (key || len < pool->ValueLength())) {
+    str = const_cast<char*>(ps.ctx->Intern(bytes, len));
+    if (str) return ret;
+  }
+  str = CopyWithNull(bytes, len, ps.arena);
+  if (str == NULL) return JsonStatus::kJSON_OUT_OF_MEMORY;
+  owned = (ps.arena == NULL);
+  return ret;
 }
 
-/* Note: Object member is sorted by key. */
-Member* FindMemberByKey(Member* p, int size, const char* k, int klen) {
-  int left = 0, right = size;
-  while (right - left > 1) {
-    int mid = left + (right - left) / 2;
-    int len = p[mid].KLen();
-    if (Compare(p[mid].Key(), len, k, len) <= 0) {
-      left = mid;
+/* Token sources for Value::ParseTree: the input bytes, or the offsets that
+ * stage 1 of kPARSE_TWO_STAGE found in them. Peek() is the first byte of the
+ * next token, '\0' past the last one. Token() is the input from there on,
+ * for a string or scalar parser to consume; Consumed() then moves past it,
+ * while Next() moves past a structural character. */
+class TextCursor {
+ public:
+  explicit TextCursor(Slice& s) : s_(s) {
+  }
+
+  char Peek() {
+    SkipSpace(s_);
+    return s_.Len() ? *(s_.Ptr()) : '\0';
+  }
+  void Next() { s_.Move(1); }
+  Slice& Token() { return s_; }
+  bool Consumed() { return true; }
+
+ private:
+  Slice& s_;
+};
+
+class IndexCursor {
+ public:
+  IndexCursor(const char* text, int len, const uint32_t* index, int num)
+    : text_(text), len_(len), index_(index), num_(num), next_(0), tok_() {
+  }
+
+  char Peek() { return next_ < num_ ? text_[index_[next_]] : '\0'; }
+  void Next() { ++next_; }
+  /* Empty once the index runs out, as at the end of a TextCursor. */
+  Slice& Token() {
+    int pos = next_ < num_ ? static_cast<int>(index_[next_]) : len_;
+    tok_ = Slice(text_ + pos, len_ - pos);
+    return tok_;
+  }
+  /* False for e.g. "truex" or "1x", which stage 1 indexes as one run. */
+  bool Consumed() {
+    ++next_;
+    return tok_.Len() == 0 || EndsScalarRun(*(tok_.Ptr()));
+  }
+  bool AtEnd() const { return next_ == num_; }
+
+ private:
+  const char* text_;
+  int len_;
+  const uint32_t* index_;
+  int num_;
+  int next_;
+  Slice tok_;
+};
+
+/* Reads the inside of a container as the whole container: Peek() yields
+ * @open first, and the matching bracket once @cur runs out. */
+template <typename Cursor>
+class EnclosedCursor {
+ public:
+  EnclosedCursor(Cursor& cur, char open)
+    : cur_(cur), open_(open), close_(open == '{' ? '}' : ']'), state_(kOPEN) {
+  }
+
+  char Peek() {
+    if (state_ != kINSIDE) return state_ == kOPEN ? open_ : '\0';
+    char c = cur_.Peek();
+    return c ? c : close_;
+  }
+  void Next() {
+    if (state_ == kOPEN) {
+      state_ = kINSIDE;
+    } else if (cur_.Peek() == '\0') {
+      state_ = kCLOSED;
     } else {
-      right = mid;
+      cur_.Next();
     }
   }
-  /* return value should be less-or-equal compared to the target. */
-  return p + left;
+  Slice& Token() { return cur_.Token(); }
+  bool Consumed() { return cur_.Consumed(); }
+  /* True once the synthetic closing bracket is taken, i.e. nothing of the
+   * inside was left over. */
+  bool AtEnd() const { return state_ == kCLOSED; }
+
+ private:
+  enum { kOPEN, kINSIDE, kCLOSED };
+
+  Cursor& cur_;
+  char open_;
+  char close_;
+  int state_;
+};
+
+/* A container being parsed by Value::ParseTree: its children are
+ * stk[head, top) and, in an object, @key is the pending key of the next
+ * member. */
+struct TreeFrame {
+  int head;
+  int num;
+  bool object;
+  char* key;
+  int klen;
+  bool own_key;
+};
+
+/* An element or member block that Free() has yet to release. */
+struct PendingBlock {
+  void* p;
+  int size;
+  bool object;
+};
+
+/* Parse the key and the colon of the next member of @f. */
+template <typename Cursor>
+JsonStatus ParseKey(ParseState& ps, Cursor& cur, TreeFrame& f) {
+  if (cur.Peek() != '\"') return JsonStatus::kJSON_PARSE_OBJECT_MISSING_KEY;
+  f.key = NULL;
+  f.own_key = false;
+  JsonStatus ret = ParseStringForTree(ps, cur.Token(), true, f.key, f.klen, f.own_key);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  if (!cur.Consumed() || cur.Peek() != ':') {
+    return JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON;
+  }
+  cur.Next();
+  return ret;
 }
 
-/* Push Member  by key-order. */
-/* @num is the number of member that was just pushed. */
-Member* PushMemberInOrder(Member* dst, int num, const char* k, int len, const Value* v) {
-  Member* pos = NULL;
-  Member* cur = dst + num;
-  if (num == 0) {
-    pos = cur;
-  } else {
-    if (Compare((cur - 1)->Key(), (cur - 1)->KLen(), k, len) <= 0) {
-      pos = cur;
+inline bool KeyLess(const Member& l, const Member& r) {
+  return Compare(l.Key(), l.KLen(), r.Key(), r.KLen()) < 0;
+}
+
+/* Merge the sorted runs @l and @r into @out; on equal keys @l comes first.
+ * @r may already sit at the end of @out, i.e. at @out + @nl. */
+void MergeMembers(const Member* l, int nl, const Member* r, int nr, Member* out) {
+  while (nl > 0 && nr > 0) {
+    if (KeyLess(*r, *l)) {
+      memcpy(static_cast<void*>(out++), r++, sizeof(Member));
+      --nr;
     } else {
-      Member* start = cur - num;
-      pos = FindMemberByKey(start, num, k, len);
-      if (Compare(pos->Key(), pos->KLen(), k, len) <= 0) {
-        pos += 1;
-      }
-      memmove(pos + 1, pos, (cur - pos) * sizeof(Member));
+      memcpy(static_cast<void*>(out++), l++, sizeof(Member));
+      --nl;
     }
   }
-  memset(pos, 0, sizeof(*pos));
-  return pos;
-}
-
-Member* PushMemberInOrder(Member* dst, int num, const Member* cur) {
-  return PushMemberInOrder(dst, num, cur->Key(), cur->KLen(), cur->Val());
+  if (nl > 0) memmove(static_cast<void*>(out), l, nl * sizeof(Member));
+  if (nr > 0) memmove(static_cast<void*>(out), r, nr * sizeof(Member));
+}
+
+/* Stable merge sort of @a[0, num) by key, ending in @b if @to_b, else in
+ * @a. The other array is scratch of the same size. */
+void SortMembersInto(Member* a, Member* b, int num, bool to_b) {
+  if (num <= 8) {
+    for (int i = 1; i < num; ++i) {
+      const char* k = a[i].Key();
+      int klen = a[i].KLen();
+      int j = i;
+      while (j > 0 && Compare(k, klen, a[j - 1].Key(), a[j - 1].KLen()) < 0) --j;
+      if (j == i) continue;
+      char tmp[sizeof(Member)];
+      memcpy(tmp, static_cast<void*>(a + i), sizeof(Member));
+      memmove(static_cast<void*>(a + j + 1), a + j, (i - j) * sizeof(Member));
+      memcpy(static_cast<void*>(a + j), tmp, sizeof(Member));
+    }
+    if (to_b) memcpy(static_cast<void*>(b), a, num * sizeof(Member));
+    return;
+  }
+  int half = num / 2;
+  SortMembersInto(a, b, half, !to_b);
+  SortMembersInto(a + half, b + half, num - half, !to_b);
+  Member* src = to_b ? a : b;
+  Member* dst = to_b ? b : a;
+  MergeMembers(src, half, src + half, num - half, dst);
+}
+
+/* Put the @num members of @src into @dst sorted by key, keeping the input
+ * order of duplicate keys. Objects are built by appending members and
+ * sorting once, instead of inserting each in place, which is quadratic.
+ * @src is clobbered. */
+void SortMembers(Member* src, Member* dst, int num) {
+  int i = 1;
+  while (i < num && !KeyLess(src[i], src[i - 1])) ++i;
+  if (i < num) {
+    SortMembersInto(src, dst, num, true);
+  } else if (num > 0) {
+    memcpy(static_cast<void*>(dst), src, num * sizeof(Member));
+  }
 }
 
 bool CompareString(const Value* lhs, const Value* rhs) {
@@ -262,40 +386,23 @@ bool CompareString(const Value* lhs, const Value* rhs) {
   return Compare(l, llen, r, rlen) == 0;
 }
 
-bool CompareArray(const Value* lhs, const Value* rhs) {
-  assert(lhs && rhs && lhs->Type() == kJSON_ARRAY 
-         && rhs->Type() == kJSON_ARRAY);
-  int num = lhs->GetArraySize();
-  if (num != rhs->GetArraySize()) return false;
-  if (num == 0) return true;
-  const Value* lhs_p = lhs->GetArrayValue(0);
-  const Value* rhs_p = rhs->GetArrayValue(0);
-  for (int i = 0; i < num; ++i) {
-    if (!Compare(lhs_p + i, rhs_p + i)) return false;
-  }
-  return true;
-}
-
 int CompareMember(const Member* lhs, const Member* rhs) {
   assert(lhs && rhs);
   return Compare(lhs->Key(), lhs->KLen(), rhs->Key(), rhs->KLen());
 }
 
-bool CompareObject(const Value* lhs, const Value* rhs) {
-  assert(lhs && rhs && lhs->Type() == kJSON_OBJECT 
-         && rhs->Type() == kJSON_OBJECT);
-  int size = lhs->GetObjectSize();
-  if (size != rhs->GetObjectSize()) return false;
-  if (size == 0) return true;
-  const Member* lp = lhs->GetObjectMember(0);
-  const Member* rp = rhs->GetObjectMember(0);
-  for (int i = 0; i < size; ++i) {
-    if (CompareMember(lp + i, rp + i) != 0
-        || !Compare(lp[i].Val(), rp[i].Val())) {
-      return false;
-    }
-  }
-  return true;
+/* A container being walked by Compare (@lhs and @rhs), and the child
+ * being visited. */
+struct WalkFrame {
+  const Value* lhs;
+  const Value* rhs;
+  int index;
+};
+
+int ChildCount(const Value* v) {
+  if (v->Type() == kJSON_ARRAY) return v->GetArraySize();
+  if (v->Type() == kJSON_OBJECT) return v->GetObjectSize();
+  return 0;
 }
 
 /* Note: Object member is sorted by key. */
@@ -313,250 +420,77 @@ static Member* FindObjectMemberByKey(Member* p, int size, const char* k, int kle
   return p + left;
 }
 
-/*=============================Generator Static functions=====================*/
-
-void LiteralToString(Stack& stk, const char* s, int len) {
-  memcpy(stk.Push(len), s, len);
-}
-
-void NumberToString(Stack& stk, const Value* v) {
-  char buf[32];
-  int len = sprintf(buf, "%.17g", v->GetNumber());
-  memcpy(stk.Push(len), buf, len);
-}
-
-uint32_t DecodeUTF8(const char* p, int* bytes) {
-  uint32_t codepoint = 0;
-  if ((*p & 0xF8) == 0xF0) {
-    assert((p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80);
-    assert((p[3] & 0xC0) == 0x80);
-    *bytes = 4;
-    codepoint =  p[3] & 0x3F;
-    codepoint |= (p[2] & 0x3F) <<  6;
-    codepoint |= (p[1] & 0x3F) << 12;
-    codepoint |= (p[0] & 0x07) << 18;
-  } else if ((*p & 0xF0) == 0xE0) {
-    assert((p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80); 
-    *bytes = 3;
-    codepoint =  p[2] & 0x3F;
-    codepoint |= (p[1] & 0x3F) <<  6;
-    codepoint |= (p[0] & 0x0F) << 12;             
-  } else if ((*p & 0xE0) == 0xC0) {
-    assert((p[1] & 0xC0) == 0x80); 
-    *bytes = 2;
-    codepoint =  p[1] & 0x3F;
-    codepoint |= (p[0] & 0x1F) <<  6;    
-  }
-  return codepoint;
-}
-
-void StringToString(Stack& stk, const Value* v) {
-  stk.PushString("\"", 1);
-  int len = v->GetStringLength();
-  const char* p = v->GetString();
-  stk.Prepare(len);
-  for (int i = 0; i < len;) {
-    int step = 1;
-    switch (*p) {
-      case '\\': stk.PushString("\\\\", 2); break;
-      case '\"': stk.PushString("\\\"", 2); break;
-      case '\b': stk.PushString("\\b", 2);  break;
-      case '\f': stk.PushString("\\f", 2);  break;
-      case '\n': stk.PushString("\\n", 2);  break;
-      case '\r': stk.PushString("\\r", 2);  break;
-      case '\t': stk.PushString("\\t", 2);  break;
-      case '/':  stk.PushString("\\/", 2);  break;
-      default:   if (*p < 0x20) {
-                   stk.PushHex(*p);
-                 } else if ((*p & 0x80) == 0x00) {
-                   stk.PushString(p, 1);
-                 } else {
-                   int bytes = 0;
-                   uint32_t codepoint = DecodeUTF8(p, &bytes);
-                   step = bytes;
-                   if (codepoint < 0x100000) {
-                     stk.PushHex(codepoint & 0xFFFF);
-                   } else {
-                     // extract surrogate pair;
-#pragma GCC diagnostic ignored "-Wconversion"
-                     uint16_t high = static_cast<uint16_t>(((codepoint - 0x10000) >> 10));
-                     uint16_t low =  static_cast<uint16_t>((codepoint - 0x10000 - (high << 10)) + 0xDC00);
-                     high += static_cast<uint16_t>(0xD800);
-#pragma GCC diagnostic error "-Wconversion"
-                     stk.PushHex(high);
-                     stk.PushHex(low);
-                   }
-                 }
-    }
-    p += step;
-    i += step;
-  }
-  stk.PushString("\"", 1);
-}
-
-void ValueToString(Stack& stk, const Value* v);
-void ArrayToString(Stack& stk, const Value* v) {
-  stk.PushString("[", 1);  
-  int size = v->GetArraySize();
-  for (int i = 0; i < size; ++i) {
-    ValueToString(stk, v->GetArrayValue(i));
-    stk.PushString(",", 1);
-  }
-  if (size) stk.Pop(1); // pop the extra comma
-  stk.PushString("]", 1);  
-}
-
-void ObjectToString(Stack& stk, const Value* v) {
-  stk.PushString("{", 1);  
-  int size = v->GetObjectSize();
-  for (int i = 0; i < size; ++i) {
-    const Member* m  = v->GetObjectMember(i);
-    stk.PushString("\"", 1);
-    stk.PushString(m->Key(), m->KLen());
-    stk.PushString("\"", 1);
-    stk.PushString(":", 1);
-    ValueToString(stk, m->Val());
-    stk.PushString(",", 1);
-  }
-  if (size) stk.Pop(1); // pop the extra comma
-  stk.PushString("}", 1);  
-}
-
-void ValueToString(Stack& stk, const Value* v) {
-  switch (v->Type()) {
-    case kJSON_NULL:   LiteralToString(stk, "null", 4);  break;
-    case kJSON_FALSE:  LiteralToString(stk, "false", 5); break;
-    case kJSON_TRUE:   LiteralToString(stk, "true", 4);  break;
-    case kJSON_NUMBER: NumberToString(stk, v);           break; 
-    case kJSON_STRING: StringToString(stk, v);           break;
-    case kJSON_ARRAY:  ArrayToString(stk, v);            break;
-    case kJSON_OBJECT: ObjectToString(stk, v);           break;
-  }
-}
-
-inline char* CopyBytes(const char* k, int len) {
-  char* p = static_cast<char*>(malloc(len));
-  if (p) memcpy(p, k, len);
-  return p;
-}
-
-inline char* CopyWithNull(const char* k, int len) {
-  char* p = static_cast<char*>(malloc(len + 1));
-  if (p) {
-    memcpy(p, k, len);
-    p[len] = '\0';
+/* Numbers of any representation compare by value. */
+bool CompareNumber(const Value* lhs, const Value* rhs) {
+  ValueType l = lhs->Type(), r = rhs->Type();
+  if (l == kJSON_NUMBER || r == kJSON_NUMBER) {
+    return lhs->GetNumber() == rhs->GetNumber();
   }
-  return p;
-}
-
-inline void* MallocWithClear(int size) {
-  void* p = malloc(size);
-  if (p) memset(p, 0, size);
-  return p;
+  /* kJSON_UINT64 only holds values above INT64_MAX. */
+  if (l != r) return false;
+  return l == kJSON_INT64 ? lhs->GetInt64() == rhs->GetInt64()
+                          : lhs->GetUint64() == rhs->GetUint64();
 }
 
-} // static-function namespace
-
-bool Compare(const Value* lhs, const Value* rhs) {
-  assert(lhs && rhs);
+/* Compares the values themselves, and only the sizes of containers. */
+bool CompareShallow(const Value* lhs, const Value* rhs) {
+  if (lhs->IsNumber() && rhs->IsNumber()) return CompareNumber(lhs, rhs);
   ValueType l = lhs->Type(), r = rhs->Type();
   if (l != r) return false;
   switch (l) {
     case kJSON_NULL:   // fall through
     case kJSON_FALSE:  // fall through
     case kJSON_TRUE:   return true;
-    case kJSON_NUMBER: return (lhs->GetNumber() == rhs->GetNumber());
     case kJSON_STRING: return CompareString(lhs, rhs);
-    case kJSON_ARRAY:  return CompareArray(lhs, rhs);
-    case kJSON_OBJECT: return CompareObject(lhs, rhs);
+    case kJSON_ARRAY:  // fall through
+    case kJSON_OBJECT: return ChildCount(lhs) == ChildCount(rhs);
     default:           return false; // won't be here.
   }
 }
 
-JsonStatus Value::ParseObject(Stack& stk, Slice& s) {
-  type_ = kJSON_OBJECT;
-  s.Move(1);
-  const char* p = s.Ptr();
-  SkipSpace(s);
-  if (*p == '}') {
-    val_.o.m = NULL;
-    val_.o.size = 0;
-    s.Move(1);
-    return JsonStatus::kJSON_OK;
+/* Moves @lhs and @rhs to the @f.index-th children of @f; false if they are
+ * members with different keys. */
+bool NextToCompare(const WalkFrame& f, const Value*& lhs, const Value*& rhs) {
+  if (f.lhs->Type() == kJSON_ARRAY) {
+    lhs = f.lhs->GetArrayValue(f.index);
+    rhs = f.rhs->GetArrayValue(f.index);
+    return true;
   }
+  const Member* lm = f.lhs->GetObjectMember(f.index);
+  const Member* rm = f.rhs->GetObjectMember(f.index);
+  lhs = lm->Val();
+  rhs = rm->Val();
+  return CompareMember(lm, rm) == 0;
+}
 
-  JsonStatus ret;
-  int len;
-  int num = 0;
-  while (true) {
-    SkipSpace(s);
-
-    /* parse the key part */
-    p = s.Ptr();
-    if (*p != '\"') return JsonStatus::kJSON_PARSE_OBJECT_MISSING_KEY;
-    len = 0;
-    ret = ParseStringInStack(stk, s, len);
-    if (ret != JsonStatus::kJSON_OK) return ret;
-    char* sp = CopyWithNull(stk.Pop(len), len);
-    if (sp == NULL) return JsonStatus::kJSON_OUT_OF_MEMORY;
-    SkipSpace(s);
-    if (*(s.Ptr()) != ':') {
-      free(sp);
-      return JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON;
-    }
-    s.Move(1); // skip colon
+} // static-function namespace
 
-    /* parse the value part */
-    Value* val = reinterpret_cast<Value*>(MallocWithClear(sizeof(Value)));
-    if (val == NULL) {
-      free(sp);
-      return JsonStatus::kJSON_OUT_OF_MEMORY;
-    }
-    SkipSpace(s);
-    if ((ret = val->ParseValue(stk, s)) != JsonStatus::kJSON_OK) {
-      free(sp);
-      return ret;
+/* Iterative, so that a deep tree cannot overflow the call stack: @path
+ * holds the containers being compared. */
+bool Compare(const Value* lhs, const Value* rhs) {
+  assert(lhs && rhs);
+  Stack path;
+  WalkFrame f;
+  while (true) {
+    if (!CompareShallow(lhs, rhs)) return false;
+    if (ChildCount(lhs) > 0) {
+      f.lhs = lhs;
+      f.rhs = rhs;
+      f.index = 0;
+      memcpy(path.Push(sizeof(f)), &f, sizeof(f));
+      if (!NextToCompare(f, lhs, rhs)) return false;
+      continue;
     }
-
-    Member* cur = reinterpret_cast<Member*>(stk.Push(sizeof(Member)));
-    Member* pos = PushMemberInOrder(cur - num, num, sp, len, val);
-    pos->Move(sp, len, val);
-    val_.o.size = ++num;
-    SkipSpace(s);
-    if (*(s.Ptr()) == '}') {
-#pragma GCC diagnostic ignored "-Wconversion"
-      int bytes = num * sizeof(Member);
-#pragma GCC diagnostic error "-Wconversion"
-      char* dst = static_cast<char*>(MallocWithClear(bytes));
-      if (dst == NULL) return JsonStatus::kJSON_OUT_OF_MEMORY;
-      memcpy(dst, stk.Pop(bytes), bytes);
-      val_.o.m = reinterpret_cast<Member*>(dst);
-      s.Move(1);
-      break;
-    } else if (*(s.Ptr()) == ',') {
-      s.Move(1);
-      SkipSpace(s);
-      if(*(s.Ptr()) == '}') {
-        return JsonStatus::kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA;
+    while (true) {
+      if (path.Top() == 0) return true;
+      memcpy(&f, path.Pop(sizeof(f)), sizeof(f));
+      if (++f.index < ChildCount(f.lhs)) {
+        memcpy(path.Push(sizeof(f)), &f, sizeof(f));
+        if (!NextToCompare(f, lhs, rhs)) return false;
+        break;
       }
-    } else {
-      return JsonStatus::kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET;
     }
   }
-  return JsonStatus::kJSON_OK;
-}
-
-JsonStatus Value::ParseValue(Stack& stk, Slice& s) {
-  switch (*(s.Ptr())) {
-    case 'n':  return ParseLiteral(s, 'n');
-    case 'f':  return ParseLiteral(s, 'f');
-    case 't':  return ParseLiteral(s, 't');
-    case '[':  return ParseArray(stk, s);
-    case '{':  return ParseObject(stk, s);
-    case '\"': return ParseString(stk, s);
-    case '\0': return JsonStatus::kJSON_PARSE_EXPECT_VALUE;
-    default:   return ParseNumber(s);
-  }
 }
 
 JsonStatus Value::ParseLiteral(Slice& s, char c) {
@@ -580,106 +514,221 @@ JsonStatus Value::ParseLiteral(Slice& s, char c) {
   }
 
   if (valide) {
-    type_ = type;
+    type_ = static_cast<uint8_t>(type);
     return JsonStatus::kJSON_OK;
   }
   return JsonStatus::kJSON_PARSE_INVALID_VALUE;
 }
 
-JsonStatus Value::ParseString(Stack& stk, Slice& s) {
+JsonStatus Value::ParseString(ParseState& ps, Slice& s) {
   int len = 0;
-  JsonStatus ret = ParseStringInStack(stk, s, len);
-  if (ret == JsonStatus::kJSON_OK) {
-    SetString(stk.Pop(len), len);
+  char* str = NULL;
+  bool owned = false;
+  char* small = reinterpret_cast<char*>(&val_);
+  JsonStatus ret = ParseStringForTree(ps, s, false, str, len, owned, small, kINLINE_MAX);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  type_ = kJSON_STRING;
+  if (str == small) {
+    flags_ = static_cast<uint8_t>(flags_ | kINLINE | (len << kINLINE_SHIFT));
+    return ret;
   }
+  if (!owned) flags_ |= kBORROWED;
+  val_.s = str;
+  size_ = len;
   return ret;
 }
 
-JsonStatus Value::ParseArray(Stack& stk, Slice& s) {
-  type_ = kJSON_ARRAY;
-  SkipSpace(s);
-  s.Move(1);
-  const char* p = s.Ptr();
-  if (*p == ']') {
-    val_.a.a = NULL;
-    val_.a.size = 0;
-    s.Move(1);
-    return JsonStatus::kJSON_OK;
+bool Value::AssignString(const char* s, int len) {
+  static_assert(sizeof(val_) + sizeof(size_) + sizeof(tail_) == kINLINE_MAX + 1,
+                "inline strings fill val_, size_ and tail_");
+  if (len <= kINLINE_MAX) {
+    char* p = reinterpret_cast<char*>(&val_);
+    if (len > 0) memcpy(p, s, len);
+    p[len] = '\0';
+    flags_ = static_cast<uint8_t>(flags_ | kINLINE | (len << kINLINE_SHIFT));
+    return true;
   }
-  int num = 0;
+  val_.s = CopyWithNull(s, len);
+  size_ = len;
+  return val_.s != NULL;
+}
+
+JsonStatus Value::ParseNumber(Slice& s) {
+  Number num;
+  JsonStatus ret = ScanNumber(s, num);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  switch (num.kind) {
+    case Number::kINT64:  type_ = kJSON_INT64;
+                          val_.i64 = num.val.i64;
+                          break;
+    case Number::kUINT64: type_ = kJSON_UINT64;
+                          val_.u64 = num.val.u64;
+                          break;
+    default:              type_ = kJSON_NUMBER;
+                          val_.num = num.val.d;
+  }
+  return ret;
+}
+
+/* One-pass parse driven by an explicit stack of open containers instead of
+ * recursion, so that deep input cannot overflow the call stack. The
+ * innermost container is @f; the enclosing ones are saved on ps.stk, each
+ * right above the children parsed so far in its own container. */
+template <typename Cursor>
+JsonStatus Value::ParseTree(ParseState& ps, Cursor& cur) {
+  Stack& stk = ps.stk;
+  TreeFrame f;
+  memset(&f, 0, sizeof(f));
+  int depth = 0;
+  Value v; // the value just parsed
+  JsonStatus ret;
   while (true) {
-    Value* val = reinterpret_cast<Value*>(MallocWithClear(sizeof(Value)));
-    if (val == NULL) return JsonStatus::kJSON_OUT_OF_MEMORY;
-    JsonStatus ret = val->ParseValue(stk, s);
-    if (ret != JsonStatus::kJSON_OK) {
-      val->Free();
-      free(val);
-      return ret;
-    }
-    memcpy(stk.Push(sizeof(*val)), val, sizeof(*val));
-    free(val);
-    val_.a.size = ++num;
-    SkipSpace(s);
-    p = s.Ptr();
-    if (*p == ']') {
-      int bytes = num * static_cast<int>(sizeof(*val));
-      char* dst = static_cast<char*>(CopyBytes(stk.Pop(bytes), bytes));
-      if (dst == NULL) return JsonStatus::kJSON_OUT_OF_MEMORY;
-      val_.a.a = reinterpret_cast<Value*>(dst);
-      s.Move(1); // skip the ending bracket square
-      break;
-    } else if (*p == ',') {
-      s.Move(1);
-      SkipSpace(s);
-      if (*(s.Ptr()) == ']') {
-        return JsonStatus::kJSON_PARSE_ARRAY_INVALID_EXTRA_COMMA;
+    char c = cur.Peek();
+    if (c == '[' || c == '{') {
+      if (depth == JSONUTIL_PARSE_MAX_DEPTH) {
+        ret = JsonStatus::kJSON_PARSE_MAX_DEPTH_EXCEEDED;
+        break;
       }
+      cur.Next();
+      if (depth > 0) memcpy(stk.Push(sizeof(f)), &f, sizeof(f));
+      ++depth;
+      f.head = stk.Top();
+      f.num = 0;
+      f.object = (c == '{');
+      f.key = NULL;
+      f.own_key = false;
+      if (cur.Peek() != (f.object ? '}' : ']')) {
+        if (f.object && (ret = ParseKey(ps, cur, f)) != JsonStatus::kJSON_OK) break;
+        continue;
+      }
+      cur.Next();
+      v.type_ = f.object ? kJSON_OBJECT : kJSON_ARRAY;
+      memset(&v.val_, 0, sizeof(v.val_));
+      v.size_ = 0;
+      if (--depth > 0) memcpy(&f, stk.Pop(sizeof(f)), sizeof(f));
     } else {
-      return JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA;
+      switch (c) {
+        case 'n':  // fall through
+        case 'f':  // fall through
+        case 't':  ret = v.ParseLiteral(cur.Token(), c);  break;
+        case '\"': ret = v.ParseString(ps, cur.Token()); break;
+        case '\0': ret = JsonStatus::kJSON_PARSE_EXPECT_VALUE; break;
+        default:   ret = v.ParseNumber(cur.Token());
+      }
+      if (ret != JsonStatus::kJSON_OK) break;
+      if (!cur.Consumed()) {
+        ret = JsonStatus::kJSON_PARSE_INVALID_VALUE;
+        break;
+      }
     }
-  } 
-  return JsonStatus::kJSON_OK;
-}
 
-JsonStatus Value::ParseNumber(Slice& s) {
-  const char* p = s.Ptr();
-  if (!IsInvalidNumber(s)) {
-    return JsonStatus::kJSON_PARSE_INVALID_VALUE;
-  }
-
-  JsonStatus ret = JsonStatus::kJSON_OK;
-  int save_errno = errno;
-  errno = 0;
-  double num = strtod(p, NULL);
-  if (errno) {
-    // ERANGE
-    if (num == 0) {
-      ret = JsonStatus::kJSON_PARSE_NUMBER_UNDERFLOW;
-    } else {
-      ret = JsonStatus::kJSON_PARSE_NUMBER_OVERFLOW;
+    /* @v is complete: move it into its container, then close the containers
+     * that end right after it. */
+    while (depth > 0) {
+      if (f.object) {
+        Member* pos = reinterpret_cast<Member*>(stk.Push(sizeof(Member)));
+        pos->k_ = f.key;
+        pos->len_ = f.klen;
+        pos->flags_ = f.own_key ? 0 : Member::kKEY_BORROWED;
+        memcpy(static_cast<void*>(&pos->v_), &v, sizeof(v));
+        f.key = NULL;
+        f.own_key = false;
+      } else {
+        memcpy(stk.Push(sizeof(v)), &v, sizeof(v));
+      }
+      v.type_ = kJSON_NULL; // @v now lives in the container
+      v.flags_ = 0;
+      ++f.num;
+
+      char close = f.object ? '}' : ']';
+      c = cur.Peek();
+      if (c == ',') {
+        cur.Next();
+        if (cur.Peek() == close) {
+          ret = f.object ? JsonStatus::kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA
+                         : JsonStatus::kJSON_PARSE_ARRAY_INVALID_EXTRA_COMMA;
+        } else if (f.object) {
+          ret = ParseKey(ps, cur, f);
+        }
+        break;
+      }
+      if (c != close) {
+        ret = f.object ? JsonStatus::kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET
+                       : JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA;
+        break;
+      }
+      cur.Next();
+      int bytes = f.num * static_cast<int>(f.object ? sizeof(Member) : sizeof(Value));
+      int block = f.object ? MemberBlockBytes(f.num) : bytes;
+      char* dst = static_cast<char*>(Allocate(block, ps.arena));
+      if (dst == NULL) {
+        ret = JsonStatus::kJSON_OUT_OF_MEMORY;
+        break;
+      }
+      if (f.object) {
+        Member* m = reinterpret_cast<Member*>(dst);
+        SortMembers(reinterpret_cast<Member*>(stk.Pop(bytes)), m, f.num);
+        IndexMembers(m, f.num);
+      } else {
+        memcpy(dst, stk.Pop(bytes), bytes);
+      }
+      if (f.object) {
+        v.type_ = kJSON_OBJECT;
+        v.val_.m = reinterpret_cast<Member*>(dst);
+        v.size_ = f.num;
+      } else {
+        v.type_ = kJSON_ARRAY;
+        v.val_.a = reinterpret_cast<Value*>(dst);
+        v.size_ = f.num;
+      }
+      if (ps.arena) v.flags_ |= kBORROWED;
+      if (--depth > 0) memcpy(&f, stk.Pop(sizeof(f)), sizeof(f));
+    }
+    if (ret != JsonStatus::kJSON_OK) break;
+    if (depth == 0) {
+      memcpy(static_cast<void*>(this), &v, sizeof(v));
+      v.type_ = kJSON_NULL;
+      v.flags_ = 0;
+      return ret;
     }
-  } else {
-    type_ = kJSON_NUMBER;
-    val_.num = num;
   }
-  errno = save_errno;
+
+  /* Release the open containers, along with any partial key bytes a failed
+   * string parse left above their children. */
+  while (depth > 0) {
+    char* children = stk.Pop(stk.Top() - f.head);
+    if (!f.object) {
+      Value* a = reinterpret_cast<Value*>(children);
+      for (int i = 0; i < f.num; ++i) a[i].Free();
+    } else if (!ps.arena) {
+      Member* m = reinterpret_cast<Member*>(children);
+      for (int i = 0; i < f.num; ++i) m[i].Free();
+    }
+    if (f.own_key) free(f.key);
+    if (--depth > 0) memcpy(&f, stk.Pop(sizeof(f)), sizeof(f));
+  }
   return ret;
 }
 
-Value::Value(const Value& rhs): val_({{NULL, 0}}), type_(kJSON_NULL) {
+Value::Value(const Value& rhs)
+  : val_(), size_(0), tail_(), type_(kJSON_NULL), flags_(0) {
   *this = rhs;  
 }
 
 const Value& Value::operator=(const Value& src) {
   if (&src != this) {
     Free();
-    type_ = src.Type();
+    type_ = src.type_;
     switch(src.Type()) {
       case kJSON_NULL:
       case kJSON_FALSE:
       case kJSON_TRUE:   break;
       case kJSON_NUMBER: SetNumber(src.GetNumber());
                          break;
+      case kJSON_INT64:  SetInt64(src.GetInt64());
+                         break;
+      case kJSON_UINT64: SetUint64(src.GetUint64());
+                         break;
       case kJSON_STRING: SetString(src.GetString(), src.GetStringLength());
                          break;
       case kJSON_ARRAY:  SetArray(&src);
@@ -692,77 +741,622 @@ const Value& Value::operator=(const Value& src) {
   return *this;
 }
 
+const char* ParseContext::Intern(const char* s, int len) {
+  if (pool_ == NULL) return NULL;
+  Key key(s, len);
+  Interned& slot = interned_[key.Hash() % kINTERN_CACHE];
+  if (slot.s && slot.len == len && memcmp(slot.s, s, len) == 0) return slot.s;
+  const char* p = pool_->Intern(key);
+  if (p) {
+    slot.s = p;
+    slot.len = len;
+  }
+  return p;
+}
+
+Key::Key(const char* k, int len) : k_(k), len_(len), prefix_(0) {
+  assert((k != NULL || len == 0) && len >= 0);
+  hash_ = HashKey(k, len);
+  if (len >= 8) memcpy(&prefix_, k, sizeof(prefix_));
+}
+
+Key::Key(const char* k) : Key(k, static_cast<int>(strlen(k))) {
+}
+
+Key::Key(const std::string& k) : Key(k.data(), static_cast<int>(k.size())) {
+}
+
 Value::~Value() {
   Free();
 }
 
-void Value::Free() {
+/* Releases what this Value owns, except that the children of a container
+ * are left to the caller: its block is pushed onto @pending. */
+void Value::FreeShallow(Stack& pending) {
+  if (flags_ & kBORROWED) {
+    /* The storage belongs to someone else, e.g. a Document's arena. */
+    memset(&val_, 0, sizeof(val_));
+    size_ = 0;
+    flags_ = 0;
+    return;
+  }
   if (type_ == kJSON_STRING) {
-    if (val_.s.s) free(val_.s.s);
-    val_.s.s = NULL;
-    val_.s.len = 0;
-  } else if (type_ == kJSON_ARRAY) {
-    int mem_size = val_.a.size;
-    Value* p = val_.a.a;
-    for (int i = 0; i < mem_size; ++i) {
-      p[i].Free();
-    }
-    if (p) free(p);
-    val_.a.a = NULL;
-    val_.a.size = 0;
-  } else if (type_ == kJSON_OBJECT) {
-    int mem_size = val_.o.size;
-    Member* p = val_.o.m;
-    for (int i = 0; i < mem_size; ++i) {
-      p[i].Free();
-    }
-    if (p) free(p);
-    val_.o.m = NULL;
-    val_.o.size = 0;
+    if (val_.s && !(flags_ & kINLINE)) free(val_.s);
+  } else if ((type_ == kJSON_ARRAY && val_.a) || (type_ == kJSON_OBJECT && val_.m)) {
+    PendingBlock b;
+    b.object = (type_ == kJSON_OBJECT);
+    b.p = b.object ? static_cast<void*>(val_.m) : static_cast<void*>(val_.a);
+    b.size = size_;
+    memcpy(pending.Push(sizeof(b)), &b, sizeof(b));
   }
+  memset(&val_, 0, sizeof(val_));
+  size_ = 0;
+  flags_ = 0;
 }
 
-void Value::FreeOnError(Stack& stk) {
-    int num = 0;
-    if (type_ == kJSON_ARRAY) {
-      Value* p = reinterpret_cast<Value*>(stk.Dump());
-      num = val_.a.size;
-      for (int i = 0; i < num; ++i) {
-        (p + i)->Free();
-      }
-      val_.a.size = 0;
-    } else if (type_ == kJSON_OBJECT) {
-      Member* p = reinterpret_cast<Member*>(stk.Dump());
-      num = val_.o.size;
-      for (int i = 0; i < num; ++i) {
-        (p + i)->Free();
+/* Iterative, so that freeing a deep tree cannot overflow the call stack. */
+void Value::Free() {
+  Stack pending;
+  FreeShallow(pending);
+  while (pending.Top() > 0) {
+    PendingBlock b;
+    memcpy(&b, pending.Pop(sizeof(b)), sizeof(b));
+    if (!b.object) {
+      Value* a = static_cast<Value*>(b.p);
+      for (int i = 0; i < b.size; ++i) a[i].FreeShallow(pending);
+    } else {
+      Member* m = static_cast<Member*>(b.p);
+      for (int i = 0; i < b.size; ++i) {
+        m[i].FreeKey();
+        m[i].v_.FreeShallow(pending);
       }
-      val_.o.size = 0;
     }
-    stk.Free();
+    free(b.p);
+  }
+}
+
+JsonStatus Value::Parse(const char* text, int len, int flags) {
+  assert(text != NULL);
+  Reset();
+  Stack stk;
+  ParseState ps(stk, NULL, flags);
+  return ParseRoot(ps, text, len);
+}
+
+JsonStatus Value::Parse(Stack& stk, const char* text, int len, int flags) {
+  assert(text != NULL);
+  Reset();
+  stk.Pop(stk.Top()); // drop leftovers of a failed parse
+  ParseState ps(stk, NULL, flags);
+  return ParseRoot(ps, text, len);
 }
 
-JsonStatus Value::Parse(const char* text, int len) {
+JsonStatus Value::Parse(ParseContext& ctx, const char* text, int len, int flags) {
   assert(text != NULL);
+  Reset();
+  ctx.stk_.Pop(ctx.stk_.Top()); // drop leftovers of a failed parse
+  ParseState ps(ctx.stk_, NULL, flags);
+  ps.index = &ctx.index_;
+  ps.ctx = &ctx;
+  return ParseRoot(ps, text, len);
+}
+
+JsonStatus Value::ParseInsitu(char* text, int len) {
+  assert(text != NULL);
+  Reset();
   Stack stk;
+  ParseState ps(stk, NULL, kPARSE_DEFAULT, true);
+  return ParseRoot(ps, text, len);
+}
+
+JsonStatus Value::ParseRoot(ParseState& ps, const char* text, int len) {
+  if ((ps.flags & kPARSE_VALIDATE_UTF8) && !IsValidUtf8(text, text + len)) {
+    return JsonStatus::kJSON_PARSE_INVALID_UTF8;
+  }
+  if ((ps.flags & kPARSE_PARALLEL) && !ps.insitu && ParseParallel(ps, text, len)) {
+    return JsonStatus::kJSON_OK;
+  }
+  if ((ps.flags & kPARSE_TWO_STAGE) && !ps.insitu) {
+    Stack local;
+    Stack& index = ps.index ? *ps.index : local;
+    index.Pop(index.Top());
+    if (BuildStructuralIndex(text, len, index)) {
+      int num = index.Top() / static_cast<int>(sizeof(uint32_t));
+      IndexCursor cur(text, len, reinterpret_cast<const uint32_t*>(index.Dump()), num);
+      JsonStatus ret = ParseTree(ps, cur);
+      if (ret == JsonStatus::kJSON_OK && cur.AtEnd()) return ret;
+      Reset();
+      if (ret == JsonStatus::kJSON_OUT_OF_MEMORY) return ret;
+    }
+    /* Invalid input: let the one-pass parser below find the first error, so
+     * that both report the same status. */
+  }
   Slice s(text, len);
-  SkipSpace(s);
-  JsonStatus ret = ParseValue(stk, s);
+  TextCursor cur(s);
+  JsonStatus ret = ParseTree(ps, cur);
   if (ret == JsonStatus::kJSON_OK) {
     if (!CheckSingular(s)) {
       ret = JsonStatus::kJSON_PARSE_ROOT_NOT_SINGULAR;
     }
   }
   if (ret != JsonStatus::kJSON_OK) {
-    FreeOnError(stk);
+    Reset();
+  }
+  return ret;
+}
+
+/* A kPARSE_PARALLEL parse of the inside [begin, end) of the root container
+ * of @text. Piece i starts out at bounds[i]; its thread moves both of its
+ * ends forward to the next comma of the root, parses what lies between into
+ * parts[i], a container like the root, and the parts are then joined in
+ * input order. A piece without a comma of the root is left to the thread
+ * of the piece before it. */
+struct ParallelParse {
+  ParallelParse(const char* t, int b, int e, int n)
+    : text(t), begin(b), end(e), open(t[b - 1]), num(n), flags(0), pool(NULL),
+      bounds(n + 1), summaries(n), instring(n), depth(n), ok(n, 0),
+      parts(new Value[n]), arenas(NULL) {
+    for (int i = 0; i <= n; ++i) {
+      bounds[i] = begin + static_cast<int>(static_cast<int64_t>(end - begin) * i / n);
+    }
+  }
+  ~ParallelParse() {
+    delete[] parts;
+    delete[] arenas;
+  }
+
+  static void Summarize(ParallelParse* pp, int i);
+  static void Parse(ParallelParse* pp, int i);
+  /* The first comma of the root from bounds[@i] on, else end. */
+  int Cut(int i) const;
+  template <typename Cursor>
+  bool ParsePart(ParseState& ps, Cursor& cur, Value& part);
+  /* Move the parts into @root, as a container like the root of the text. */
+  bool Join(Value& root, Arena* arena);
+
+  const char* text;
+  int begin;
+  int end;
+  char open;
+  int num;
+  int flags;
+  StringPool* pool;
+  std::vector<int> bounds;
+  std::vector<PieceSummary> summaries;
+  std::vector<char> instring; /* the state at bounds[i], once known */
+  std::vector<int> depth;
+  std::vector<char> ok;
+  Value* parts;
+  Arena* arenas; /* one per piece when parsing into a Document */
+
+ private:
+  /* ParallelParse is noncopyable. */
+  ParallelParse(const ParallelParse&);
+  const ParallelParse& operator=(const ParallelParse&);
+};
+
+namespace {
+
+/* Run @fn for every piece of @pp, one thread each. */
+void RunPieces(void (*fn)(ParallelParse*, int), ParallelParse* pp) {
+  std::vector<std::thread> pool;
+  for (int i = 1; i < pp->num; ++i) {
+    pool.push_back(std::thread(fn, pp, i));
+  }
+  fn(pp, 0);
+  for (size_t i = 0; i < pool.size(); ++i) {
+    pool[i].join();
+  }
+}
+
+inline bool IsSpaceByte(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0';
+}
+
+/* Stable merge of the sorted runs @m[runs[k], runs[k + 1]) into one, in
+ * pairs so that each member moves about log2(runs) times; @tmp holds as
+ * many members as @m. */
+void MergeRuns(Member* m, Member* tmp, std::vector<int> runs) {
+  Member* src = m;
+  Member* dst = tmp;
+  while (runs.size() > 2) {
+    std::vector<int> next;
+    size_t k = 0;
+    for (; k + 2 < runs.size(); k += 2) {
+      MergeMembers(src + runs[k], runs[k + 1] - runs[k], src + runs[k + 1],
+                   runs[k + 2] - runs[k + 1], dst + runs[k]);
+      next.push_back(runs[k]);
+    }
+    if (k + 1 < runs.size()) {
+      memcpy(static_cast<void*>(dst + runs[k]), src + runs[k],
+             (runs[k + 1] - runs[k]) * sizeof(Member));
+      next.push_back(runs[k]);
+    }
+    next.push_back(runs.back());
+    runs.swap(next);
+    Member* t = src;
+    src = dst;
+    dst = t;
+  }
+  if (src != m) memcpy(static_cast<void*>(m), src, runs.back() * sizeof(Member));
+}
+
+} // static-function namespace
+
+void ParallelParse::Summarize(ParallelParse* pp, int i) {
+  SummarizePiece(pp->text, pp->bounds[i], pp->bounds[i + 1], pp->summaries[i]);
+}
+
+int ParallelParse::Cut(int i) const {
+  for (; i < num; ++i) {
+    int c = FindTopLevelComma(text, bounds[i], bounds[i + 1], instring[i] != 0, depth[i]);
+    if (c >= 0) return c;
+  }
+  return end;
+}
+
+void ParallelParse::Parse(ParallelParse* pp, int i) {
+  int start = pp->begin;
+  if (i > 0) {
+    start = pp->Cut(i);
+    if (start >= pp->bounds[i + 1]) {
+      pp->ok[i] = 1; // no comma of the root: an earlier part takes the piece
+      return;
+    }
+    ++start;
+  }
+  int stop = pp->Cut(i + 1);
+  const char* p = pp->text + start;
+  int len = stop - start;
+
+  Stack stk;
+  ParseState ps(stk, pp->arenas ? &pp->arenas[i] : NULL, pp->flags);
+  ParseContext ctx(pp->pool);
+  if (pp->pool) ps.ctx = &ctx;
+  bool ret = false;
+  if (pp->flags & kPARSE_TWO_STAGE) {
+    Stack index;
+    if (BuildStructuralIndex(p, len, index)) {
+      int n = index.Top() / static_cast<int>(sizeof(uint32_t));
+      IndexCursor inner(p, len, reinterpret_cast<const uint32_t*>(index.Dump()), n);
+      EnclosedCursor<IndexCursor> cur(inner, pp->open);
+      ret = pp->ParsePart(ps, cur, pp->parts[i]);
+    }
   } else {
-    stk.Free();
+    Slice s(p, len);
+    TextCursor inner(s);
+    EnclosedCursor<TextCursor> cur(inner, pp->open);
+    ret = pp->ParsePart(ps, cur, pp->parts[i]);
+  }
+  pp->ok[i] = ret ? 1 : 0;
+}
+
+template <typename Cursor>
+bool ParallelParse::ParsePart(ParseState& ps, Cursor& cur, Value& part) {
+  JsonStatus ret = part.ParseTree(ps, cur);
+  /* An empty part means a stray comma, e.g. "[1,,2]". */
+  if (ret == JsonStatus::kJSON_OK && cur.AtEnd() && part.size_ > 0) return true;
+  part.Reset();
+  return false;
+}
+
+bool ParallelParse::Join(Value& root, Arena* arena) {
+  bool object = (open == '{');
+  std::vector<int> runs(1, 0);
+  for (int i = 0; i < num; ++i) {
+    if (parts[i].size_ > 0) runs.push_back(runs.back() + parts[i].size_);
+  }
+  int total = runs.back();
+  size_t unit = object ? sizeof(Member) : sizeof(Value);
+  Member* tmp = NULL;
+  if (object && runs.size() > 2) {
+    tmp = static_cast<Member*>(malloc(total * sizeof(Member)));
+    if (tmp == NULL) return false;
+  }
+  char* dst = static_cast<char*>(
+    Allocate(object ? MemberBlockBytes(total) : total * static_cast<int>(unit), arena));
+  if (dst == NULL) {
+    free(tmp);
+    return false;
+  }
+  char* out = dst;
+  for (int i = 0; i < num; ++i) {
+    Value& part = parts[i];
+    if (part.size_ == 0) continue;
+    void* block = object ? static_cast<void*>(part.val_.m) : static_cast<void*>(part.val_.a);
+    memcpy(out, block, part.size_ * unit);
+    out += part.size_ * unit;
+    if (!(part.flags_ & Value::kBORROWED)) free(block);
+    memset(static_cast<void*>(&part), 0, sizeof(part)); // the children moved
+  }
+  root.type_ = static_cast<uint8_t>(object ? kJSON_OBJECT : kJSON_ARRAY);
+  root.size_ = total;
+  if (object) {
+    Member* m = reinterpret_cast<Member*>(dst);
+    if (tmp) MergeRuns(m, tmp, runs);
+    free(tmp);
+    IndexMembers(m, total);
+    root.val_.m = m;
+  } else {
+    root.val_.a = reinterpret_cast<Value*>(dst);
+  }
+  if (arena) {
+    root.flags_ |= Value::kBORROWED;
+    for (int i = 0; i < num; ++i) arena->Adopt(arenas[i]);
+  }
+  return true;
+}
+
+bool Value::ParseParallel(ParseState& ps, const char* text, int len) {
+  const char* first = SkipWhitespace(text, text + len);
+  const char* last = text + len;
+  while (last > first && IsSpaceByte(last[-1])) --last;
+  if (last - first < 2) return false;
+  char open = *first;
+  if (!((open == '[' && last[-1] == ']') || (open == '{' && last[-1] == '}'))) {
+    return false;
+  }
+  int begin = static_cast<int>(first + 1 - text);
+  int end = static_cast<int>(last - 1 - text);
+  int threads = ps.ctx ? ps.ctx->GetThreads() : 0;
+  if (threads <= 0) threads = static_cast<int>(std::thread::hardware_concurrency());
+  int pieces = (end - begin) / JSONUTIL_PARALLEL_PIECE_SIZE;
+  if (pieces > threads) pieces = threads;
+  if (pieces < 2) return false;
+
+  ParallelParse pp(text, begin, end, pieces);
+  pp.flags = ps.flags & ~kPARSE_PARALLEL;
+  pp.pool = ps.ctx ? ps.ctx->GetStringPool() : NULL;
+  if (ps.arena) pp.arenas = new Arena[pieces];
+  /* Whether a piece starts inside a string follows from the parity of the
+   * quotes before it, which every piece counts on its own. */
+  RunPieces(ParallelParse::Summarize, &pp);
+  bool instring = false;
+  int depth = 0;
+  for (int i = 0; i < pieces; ++i) {
+    pp.instring[i] = instring ? 1 : 0;
+    pp.depth[i] = depth;
+    depth += pp.summaries[i].depth[instring ? 1 : 0];
+    if (pp.summaries[i].quotes & 1) instring = !instring;
+  }
+  RunPieces(ParallelParse::Parse, &pp);
+  for (int i = 0; i < pieces; ++i) {
+    if (!pp.ok[i]) return false;
+  }
+  return pp.Join(*this, ps.arena);
+}
+
+Document::~Document() {
+  Value::Reset();
+}
+
+JsonStatus Document::Parse(const char* text, int len, int flags) {
+  assert(text != NULL);
+  Reset();
+  Stack stk;
+  ParseState ps(stk, &arena_, flags);
+  JsonStatus ret = ParseRoot(ps, text, len);
+  if (ret != JsonStatus::kJSON_OK) {
+    arena_.Reset();
   }
   return ret;
 }
 
+JsonStatus Document::Parse(ParseContext& ctx, const char* text, int len, int flags) {
+  assert(text != NULL);
+  Reset();
+  ctx.stk_.Pop(ctx.stk_.Top());
+  ParseState ps(ctx.stk_, &arena_, flags);
+  ps.index = &ctx.index_;
+  ps.ctx = &ctx;
+  JsonStatus ret = ParseRoot(ps, text, len);
+  if (ret != JsonStatus::kJSON_OK) {
+    arena_.Reset();
+  }
+  return ret;
+}
+
+JsonStatus Document::ParseInsitu(char* text, int len) {
+  assert(text != NULL);
+  Reset();
+  Stack stk;
+  ParseState ps(stk, &arena_, kPARSE_DEFAULT, true);
+  JsonStatus ret = ParseRoot(ps, text, len);
+  if (ret != JsonStatus::kJSON_OK) {
+    arena_.Reset();
+  }
+  return ret;
+}
+
+JsonStatus Document::MapFile(const char* path, bool writable) {
+  if (!file_.Open(path, writable) || file_.Size() > INT_MAX) {
+    file_.Close();
+    return JsonStatus::kJSON_FILE_IO_ERROR;
+  }
+  return JsonStatus::kJSON_OK;
+}
+
+JsonStatus Document::ParseFile(const char* path, int flags) {
+  Reset();
+  JsonStatus ret = MapFile(path, false);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  const char* text = file_.Data() ? file_.Data() : ""; // empty file
+  int len = static_cast<int>(file_.Size());
+  Stack stk;
+  ParseState ps(stk, &arena_, flags);
+  ret = ParseRoot(ps, text, len);
+  if (ret != JsonStatus::kJSON_OK) {
+    arena_.Reset();
+  }
+  if (ret != JsonStatus::kJSON_OK || !(flags & kPARSE_ZERO_COPY)) {
+    file_.Close();
+  }
+  return ret;
+}
+
+JsonStatus Document::ParseFileInsitu(const char* path) {
+  Reset();
+  JsonStatus ret = MapFile(path, true);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  char empty[1] = { '\0' };
+  char* text = file_.Data() ? file_.Data() : empty;
+  Stack stk;
+  ParseState ps(stk, &arena_, kPARSE_DEFAULT, true);
+  ret = ParseRoot(ps, text, static_cast<int>(file_.Size()));
+  if (ret != JsonStatus::kJSON_OK) {
+    arena_.Reset();
+    file_.Close();
+  }
+  return ret;
+}
+
+void Document::Reset(ValueType t) {
+  Value::Reset(t);
+  arena_.Reset();
+  file_.Close();
+}
+
+bool ValueHandler::Place(Value& v) {
+  if (depth_ == 0) {
+    root_.Take(v);
+  } else if (!cur_.object) {
+    memcpy(stk_.Push(sizeof(Value)), &v, sizeof(Value));
+  } else {
+    Member* m = reinterpret_cast<Member*>(stk_.Push(sizeof(Member)));
+    m->k_ = cur_.key;
+    m->len_ = cur_.klen;
+    m->flags_ = 0;
+    memcpy(static_cast<void*>(&m->v_), &v, sizeof(Value));
+    cur_.key = NULL;
+    cur_.klen = 0;
+  }
+  v.type_ = kJSON_NULL; // the payload now lives in the tree
+  v.flags_ = 0;
+  return true;
+}
+
+bool ValueHandler::Null() {
+  Value v;
+  return Place(v);
+}
+
+bool ValueHandler::Bool(bool b) {
+  Value v(b ? kJSON_TRUE : kJSON_FALSE);
+  return Place(v);
+}
+
+bool ValueHandler::Int64(int64_t i) {
+  Value v;
+  v.SetInt64(i);
+  return Place(v);
+}
+
+bool ValueHandler::Uint64(uint64_t u) {
+  Value v;
+  v.SetUint64(u);
+  return Place(v);
+}
+
+bool ValueHandler::Number(double d) {
+  Value v;
+  v.SetNumber(d);
+  return Place(v);
+}
+
+bool ValueHandler::String(const char* s, int len) {
+  Value v;
+  if (!v.AssignString(s, len)) return false;
+  v.type_ = kJSON_STRING;
+  return Place(v);
+}
+
+bool ValueHandler::Start(bool object) {
+  if (depth_ > 0) memcpy(frames_.Push(sizeof(Frame)), &cur_, sizeof(Frame));
+  cur_.head = stk_.Top();
+  cur_.object = object;
+  cur_.key = NULL;
+  cur_.klen = 0;
+  ++depth_;
+  return true;
+}
+
+bool ValueHandler::StartObject() {
+  return Start(true);
+}
+
+bool ValueHandler::StartArray() {
+  return Start(false);
+}
+
+bool ValueHandler::Key(const char* s, int len) {
+  assert(depth_ > 0 && cur_.object && cur_.key == NULL);
+  cur_.key = CopyWithNull(s, len);
+  cur_.klen = len;
+  return cur_.key != NULL;
+}
+
+bool ValueHandler::EndObject(int size) {
+  assert(depth_ > 0 && cur_.object);
+  int bytes = stk_.Top() - cur_.head;
+  int num = bytes / static_cast<int>(sizeof(Member));
+  assert(num == size);
+  Member* dst = NULL;
+  if (num > 0) {
+    dst = static_cast<Member*>(Allocate(MemberBlockBytes(num)));
+    if (dst == NULL) return false;
+    SortMembers(reinterpret_cast<Member*>(stk_.Pop(bytes)), dst, num);
+    IndexMembers(dst, num);
+  }
+  if (--depth_ > 0) memcpy(&cur_, frames_.Pop(sizeof(Frame)), sizeof(Frame));
+  Value v(kJSON_OBJECT);
+  v.val_.m = dst;
+  v.size_ = num;
+  return Place(v);
+}
+
+bool ValueHandler::EndArray(int size) {
+  assert(depth_ > 0 && !cur_.object);
+  int bytes = stk_.Top() - cur_.head;
+  int num = bytes / static_cast<int>(sizeof(Value));
+  assert(num == size);
+  Value* dst = NULL;
+  if (num > 0) {
+    dst = static_cast<Value*>(Allocate(bytes));
+    if (dst == NULL) return false;
+    memcpy(static_cast<void*>(dst), stk_.Pop(bytes), bytes);
+  }
+  if (--depth_ > 0) memcpy(&cur_, frames_.Pop(sizeof(Frame)), sizeof(Frame));
+  Value v(kJSON_ARRAY);
+  v.val_.a = dst;
+  v.size_ = num;
+  return Place(v);
+}
+
+void ValueHandler::Reset() {
+  while (depth_ > 0) {
+    int bytes = stk_.Top() - cur_.head;
+    char* p = stk_.Pop(bytes);
+    if (cur_.object) {
+      Member* m = reinterpret_cast<Member*>(p);
+      for (int i = 0; i < bytes / static_cast<int>(sizeof(Member)); ++i) m[i].Free();
+    } else {
+      Value* a = reinterpret_cast<Value*>(p);
+      for (int i = 0; i < bytes / static_cast<int>(sizeof(Value)); ++i) a[i].Free();
+    }
+    if (cur_.key) free(cur_.key);
+    cur_.key = NULL;
+    if (--depth_ > 0) memcpy(&cur_, frames_.Pop(sizeof(Frame)), sizeof(Frame));
+  }
+}
+
+bool Value::IsNumber() const {
+  return (type_ == kJSON_NUMBER || type_ == kJSON_INT64 || type_ == kJSON_UINT64);
+}
+
 double Value::GetNumber() const {
-  assert(type_ == kJSON_NUMBER);
+  assert(IsNumber());
+  if (type_ == kJSON_INT64) return static_cast<double>(val_.i64);
+  if (type_ == kJSON_UINT64) return static_cast<double>(val_.u64);
   return val_.num;
 }
 
@@ -772,6 +1366,37 @@ void Value::SetNumber(double num) {
   val_.num = num;
 }
 
+int64_t Value::GetInt64() const {
+  assert(type_ == kJSON_INT64);
+  return val_.i64;
+}
+
+void Value::SetInt64(int64_t num) {
+  Reset();
+  type_ = kJSON_INT64;
+  val_.i64 = num;
+}
+
+uint64_t Value::GetUint64() const {
+  assert(type_ == kJSON_INT64 || type_ == kJSON_UINT64);
+  if (type_ == kJSON_INT64) {
+    assert(val_.i64 >= 0);
+    return static_cast<uint64_t>(val_.i64);
+  }
+  return val_.u64;
+}
+
+void Value::SetUint64(uint64_t num) {
+  /* Keep a single representation per value, see ValueType. */
+  if (num <= static_cast<uint64_t>(INT64_MAX)) {
+    SetInt64(static_cast<int64_t>(num));
+    return;
+  }
+  Reset();
+  type_ = kJSON_UINT64;
+  val_.u64 = num;
+}
+
 bool Value::GetBoolean() const {
   assert(type_ == kJSON_FALSE || type_ == kJSON_TRUE);
   return (type_ == kJSON_FALSE) ? false : true;
@@ -789,15 +1414,15 @@ void Value::SetBoolean(bool b) {
 void Value::SetString(const char* s, int len) {
   Reset();
   type_ = kJSON_STRING;
-  val_.s.len = len;
-  char* p = val_.s.s = static_cast<char*>(CopyWithNull(s, len));
-  assert(p != NULL);
-  (void)p;
+  bool ok = AssignString(s, len);
+  assert(ok);
+  (void)ok;
 }
 
 const char* Value::GetString() const {
   assert(type_ == kJSON_STRING);
-  return val_.s.s;
+  if (flags_ & kINLINE) return reinterpret_cast<const char*>(&val_);
+  return val_.s;
 }
 
 char* Value::GetString() { 
@@ -808,19 +1433,20 @@ char* Value::GetString() {
 
 int Value::GetStringLength() const { 
   assert(type_ == kJSON_STRING);
-  return val_.s.len;
+  if (flags_ & kINLINE) return flags_ >> kINLINE_SHIFT;
+  return size_;
 }
 
 int Value::GetArraySize() const {
   assert(type_ == kJSON_ARRAY);
-  return val_.a.size;
+  return size_;
 }
 
 const Value* Value::GetArrayValue(int index) const {
   assert(type_ == kJSON_ARRAY);
-  assert(index >= 0 && index < val_.a.size);
-  assert(val_.a.a);
-  return (val_.a.a + index);
+  assert(index >= 0 && index < size_);
+  assert(val_.a);
+  return (val_.a + index);
 }
 
 Value* Value::GetArrayValue(int index) {
@@ -831,8 +1457,8 @@ Value* Value::GetArrayValue(int index) {
 
 void Value::SetArrayValue(int index, Value* value) {
   assert(type_ == kJSON_ARRAY && value);
-  assert(index >= 0 && index < val_.a.size);
-  Value* v = val_.a.a + index;
+  assert(index >= 0 && index < size_);
+  Value* v = val_.a + index;
   *v = *value;
 }
 
@@ -842,21 +1468,29 @@ void Value::MergeArrayBuilder(Builder<Value>& b) {
   int num = 0;
   const Value* p = b.Dump(num);
   if (num == 0) return;
-  val_.a.size += num;
-  val_.a.a = reinterpret_cast<Value*>(realloc(val_.a.a, val_.a.size * sizeof(*p)));
-  memcpy(val_.a.a + val_.a.size - num, p, num * sizeof(Value));
+  size_ += num;
+  if (flags_ & kBORROWED) {
+    /* The old block is in a Document's arena: copy it out, never free it. */
+    Value* a = static_cast<Value*>(malloc(size_ * sizeof(Value)));
+    if (size_ > num) memcpy(a, val_.a, (size_ - num) * sizeof(Value));
+    val_.a = a;
+    flags_ &= ~kBORROWED; // the new block is on the heap
+  } else {
+    val_.a = reinterpret_cast<Value*>(realloc(val_.a, size_ * sizeof(*p)));
+  }
+  memcpy(val_.a + size_ - num, p, num * sizeof(Value));
 }
 
 int Value::GetObjectSize() const {
   assert(type_ == kJSON_OBJECT);
-  return val_.o.size;
+  return size_;
 }
 
 const Member* Value::GetObjectMember(int index) const {
   assert(type_ == kJSON_OBJECT);
-  assert(index >= 0 && index < val_.o.size);
-  assert(val_.o.m);
-  return (val_.o.m + index);
+  assert(index >= 0 && index < size_);
+  assert(val_.m);
+  return (val_.m + index);
 }
 
 Member* Value::GetObjectMember(int index) { 
@@ -866,11 +1500,43 @@ Member* Value::GetObjectMember(int index) {
 }
 
 const Member* Value::GetMemberByKey(const char* k, int klen) const {
-  int size = val_.o.size;
-  Member* p = FindObjectMemberByKey(val_.o.m, size, k, klen);
+  int size = size_;
+  if (size == 0) return NULL;
+  if (IndexSlots(size)) return FindIndexedMember(val_.m, size, Key(k, klen));
+  Member* p = FindObjectMemberByKey(val_.m, size, k, klen);
   return Compare(k, klen, p->Key(), p->KLen()) == 0 ? p : NULL;
 }
 
+const Member* Value::GetMemberByKey(const Key& key) const {
+  assert(type_ == kJSON_OBJECT);
+  int size = size_;
+  if (size == 0) return NULL;
+  if (IndexSlots(size)) return FindIndexedMember(val_.m, size, key);
+  /* Small objects: a scan that mostly compares lengths beats the binary
+   * search. Backwards, so that the last of duplicate keys wins. */
+  for (const Member* p = val_.m + size; p-- != val_.m;) {
+    if (SameKey(*p, key)) return p;
+  }
+  return NULL;
+}
+
+Member* Value::GetMemberByKey(const Key& key) {
+  return const_cast<Member*>(
+    const_cast<const Value*>(this)->GetMemberByKey(key)
+  ); 
+}
+
+const Value* Value::GetValueByKey(const Key& key) const {
+  const Member* p = GetMemberByKey(key);
+  return p ? p->Val() : NULL;
+}
+
+Value* Value::GetValueByKey(const Key& key) {
+  return const_cast<Value*>(
+    const_cast<const Value*>(this)->GetValueByKey(key)
+  ); 
+}
+
 Member* Value::GetMemberByKey(const char* k, int klen) {
   return const_cast<Member*>(
     const_cast<const Value*>(this)->GetMemberByKey(k, klen)
@@ -892,16 +1558,21 @@ Value* Value::GetValueByKey(const char* k, int klen) {
 void Value::MergeObjectBuilder(Builder<Member>& b) {
   assert(type_ == kJSON_OBJECT);
   int num = 0;
-  const Member* p = b.Dump(num);
+  Member* p = b.Dump(num);
   if (num == 0) return;
-  int ready = val_.o.size;
-  val_.o.m = reinterpret_cast<Member*>(realloc(val_.o.m, (ready + num) * sizeof(*p)));
-  for (int i = 0; i < num; ++i) {
-    Member* pos = PushMemberInOrder(val_.o.m, ready, p + i);
-    pos->Move((p + i)->Key(), (p + i)->KLen(), (p + i)->Val());
-    ready++;
+  int ready = size_;
+  Member* m = static_cast<Member*>(Allocate(MemberBlockBytes(ready + num)));
+  /* Sort the new members into the tail, then merge the old ones in front:
+   * on equal keys the members already there come first. */
+  SortMembers(p, m + ready, num);
+  if (ready > 0) {
+    MergeMembers(val_.m, ready, m + ready, num, m);
+    if (!(flags_ & kBORROWED)) free(val_.m);
   }
-  val_.o.size = ready; 
+  IndexMembers(m, ready + num);
+  val_.m = m;
+  size_ = ready + num; 
+  flags_ &= ~kBORROWED; // the new block is on the heap
 }
 
 bool Value::SetObjectKeyValue(const char* k, int klen, Value* value) {
@@ -925,8 +1596,8 @@ void Value::SetArray(const Value* src) {
   for (int i = 0; i < size; ++i) {
     *(a + i) = *src->GetArrayValue(i);
   }
-  val_.a.a = a;
-  val_.a.size = size;
+  val_.a = a;
+  size_ = size;
 }
 
 void Value::SetObject(const Value* src) {
@@ -934,23 +1605,32 @@ void Value::SetObject(const Value* src) {
   if (src == this) return;
   Free();
   int size = src->GetObjectSize();
-#pragma GCC diagnostic ignored "-Wconversion"
-  Member* m = reinterpret_cast<Member*>(MallocWithClear(size * sizeof(Member)));
-#pragma GCC diagnostic error "-Wconversion"
+  Member* m = reinterpret_cast<Member*>(MallocWithClear(MemberBlockBytes(size)));
   for (int i = 0; i < size; ++i) {
     const Member* p = src->GetObjectMember(i);
     (m + i)->Set(p->Key(), p->KLen(), p->Val());        
   }
-  val_.o.m = m;
-  val_.o.size = size;
+  IndexMembers(m, size);
+  val_.m = m;
+  size_ = size;
 }
 
 void Value::Reset(ValueType t) {
   Free();
-  type_ = t;
+  type_ = static_cast<uint8_t>(t);
+}
+
+void Value::Take(Value& src) {
+  if (&src == this) return;
+  Free();
+  memcpy(static_cast<void*>(this), &src, sizeof(*this));
+  memset(static_cast<void*>(&src), 0, sizeof(src));
 }
 
-Member::Member(const Member& rhs) {
+static_assert(sizeof(Value) == 16, "a Value is two words");
+static_assert(sizeof(Member) <= 32, "a member is its key and an inline Value");
+
+Member::Member(const Member& rhs) : k_(NULL), len_(0), flags_(0) {
   *this = rhs;
 }
 
@@ -963,23 +1643,26 @@ Member::~Member() {
   Free();
 }
 
+void Member::FreeKey() {
+  if (k_ && !(flags_ & kKEY_BORROWED)) free(k_);
+  k_ = NULL;
+  len_ = 0;
+  flags_ &= ~kKEY_BORROWED;
+}
+
+void Member::FreeValue() {
+  v_.Reset();
+}
+
 void Member::Free() {
-  if (k_) {
-    free(k_);
-    k_ = NULL;
-    len_ = 0;
-  }
-  if (v_) {
-    v_->Reset();
-    free(v_);
-    v_ = NULL;
-  }
+  FreeKey();
+  FreeValue();
 }
 
 void Member::SetKey(const char* k, int len) {
   assert(k);
   if (k_ != k) {
-    free(k_);
+    FreeKey();
     k_ = CopyWithNull(k, len);
     len_ = len;
   }
@@ -987,14 +1670,7 @@ void Member::SetKey(const char* k, int len) {
 
 void Member::SetValue(const Value* v) {
   assert(v);
-  if (v_ != v) {
-    if(v_) {
-      v_->Reset(); 
-    } else {
-      v_ = reinterpret_cast<Value*>(MallocWithClear(sizeof(*v)));
-    }
-    *v_ = *v;
-  }
+  v_ = *v;
 }
 
 void Member::Set(const char* k, int len, const Value* v) {
@@ -1005,7 +1681,7 @@ void Member::Set(const char* k, int len, const Value* v) {
 void Member::MoveKey(const char* k, int len) {
   assert(k);
   if (k_ != k) {
-    free(k_);
+    FreeKey();
     k_ = const_cast<char*>(k);
     len_ = len;
   }
@@ -1013,9 +1689,10 @@ void Member::MoveKey(const char* k, int len) {
 
 void Member::MoveValue(const Value* v) {
   assert(v);
-  if (v_ != v) {
-    if(v_) v_->Reset(); 
-    v_ = const_cast<Value*>(v);
+  if (v != &v_) {
+    Value* node = const_cast<Value*>(v);
+    v_.Take(*node);
+    free(node);
   }
 }
 
@@ -1025,10 +1702,14 @@ void Member::Move(const char* k, int len, const Value* v) {
 }
 
 std::string Value::ToString() const {
-  Stack stk;
-  ValueToString(stk, this);
-  int len = stk.Top();
-  return (std::string(stk.Pop(len), len)).append(1, '\0');
+  std::string out;
+  char buf[4096];
+  Writer w(*this);
+  int n = 0;
+  while ((n = w.Write(buf, sizeof(buf))) > 0) {
+    out.append(buf, n);
+  }
+  return out.append(1, '\0');
 }
 
 Value& operator<<(Value& v, double num) {
@@ -1036,16 +1717,108 @@ Value& operator<<(Value& v, double num) {
   return v;
 }
 
+Value& operator<<(Value& v, int num) {
+  v.SetInt64(num);
+  return v;
+}
+
+Value& operator<<(Value& v, unsigned num) {
+  v.SetInt64(num);
+  return v;
+}
+
+Value& operator<<(Value& v, long num) {
+  v.SetInt64(num);
+  return v;
+}
+
+Value& operator<<(Value& v, unsigned long num) {
+  v.SetUint64(num);
+  return v;
+}
+
+Value& operator<<(Value& v, long long num) {
+  v.SetInt64(num);
+  return v;
+}
+
+Value& operator<<(Value& v, unsigned long long num) {
+  v.SetUint64(num);
+  return v;
+}
+
 Value& operator<<(Value& v, const std::string& s) {
   v.SetString(s.c_str(), static_cast<int>(s.size()));
   return v;
 }
 
+namespace {
+
+/* @v as an integer, whichever numeric type holds it; the value must be
+ * integral and fit. */
+int64_t ExtractInt64(const Value& v) {
+  if (v.Type() == kJSON_INT64) return v.GetInt64();
+  if (v.Type() == kJSON_UINT64) {
+    assert(v.GetUint64() <= static_cast<uint64_t>(INT64_MAX));
+    return static_cast<int64_t>(v.GetUint64());
+  }
+  double d = v.GetNumber();
+  assert(d >= -9223372036854775808.0 && d < 9223372036854775808.0);
+  assert(d == static_cast<double>(static_cast<int64_t>(d)));
+  return static_cast<int64_t>(d);
+}
+
+uint64_t ExtractUint64(const Value& v) {
+  if (v.Type() == kJSON_UINT64) return v.GetUint64();
+  if (v.Type() == kJSON_INT64) {
+    assert(v.GetInt64() >= 0);
+    return static_cast<uint64_t>(v.GetInt64());
+  }
+  double d = v.GetNumber();
+  assert(d >= 0.0 && d < 18446744073709551616.0);
+  assert(d == static_cast<double>(static_cast<uint64_t>(d)));
+  return static_cast<uint64_t>(d);
+}
+
+} // static-function namespace
+
 void operator>>(const Value& v, double& num) {
-  assert(v.Type() == kJSON_NUMBER);
+  assert(v.IsNumber());
   num = v.GetNumber();
 }
 
+void operator>>(const Value& v, int& num) {
+  int64_t i = ExtractInt64(v);
+  assert(i >= INT_MIN && i <= INT_MAX);
+  num = static_cast<int>(i);
+}
+
+void operator>>(const Value& v, unsigned& num) {
+  uint64_t u = ExtractUint64(v);
+  assert(u <= UINT_MAX);
+  num = static_cast<unsigned>(u);
+}
+
+void operator>>(const Value& v, long& num) {
+  int64_t i = ExtractInt64(v);
+  assert(i >= LONG_MIN && i <= LONG_MAX);
+  num = static_cast<long>(i);
+}
+
+void operator>>(const Value& v, unsigned long& num) {
+  uint64_t u = ExtractUint64(v);
+  assert(u <= ULONG_MAX);
+  num = static_cast<unsigned long>(u);
+}
+
+void operator>>(const Value& v, long long& num) {
+  num = ExtractInt64(v);
+}
+
+void operator>>(const Value& v, unsigned long long& num) {
+  num = ExtractUint64(v);
+}
+
 void operator>>(const Value& v, std::string& s) {
   assert(v.Type() == kJSON_STRING);
   s = std::string(v.GetString(), v.GetStringLength());
@@ -3,12 +3,27 @@
 
 #include "stack.h"
 #include "slice.h"
+#include "arena.h"
+#include "mapped_file.h"
 #include "json_status.h"
 
 #include <string>
 #include <vector>
 #include <map>
 #include <string.h>
+#include <stdint.h>
+
+/* Objects with at least this many members get a hash index of their keys,
+ * so that lookups by key take O(1) instead of a binary search. */
+#ifndef JSONUTIL_OBJECT_INDEX_MIN
+  #define JSONUTIL_OBJECT_INDEX_MIN 32
+#endif
+
+/* kPARSE_PARALLEL gives each thread at least this many bytes of input, so
+ * that smaller inputs are parsed on the calling thread alone. */
+#ifndef JSONUTIL_PARALLEL_PIECE_SIZE
+  #define JSONUTIL_PARALLEL_PIECE_SIZE (1 << 20)
+#endif
 
 namespace jsonutil {
 typedef enum {
@@ -18,32 +33,86 @@ typedef enum {
   kJSON_NUMBER, 
   kJSON_STRING, 
   kJSON_ARRAY, 
-  kJSON_OBJECT
+  kJSON_OBJECT,
+  /* Integral numbers, kept exact. The parser picks these for literals
+   * without fraction or exponent that fit in 64 bits; kJSON_UINT64 only
+   * holds values above INT64_MAX. */
+  kJSON_INT64,
+  kJSON_UINT64
 } ValueType;
 
+/* Options for Value::Parse. */
+typedef enum {
+  kPARSE_DEFAULT = 0,
+  /* Strings and keys without escapes refer into the input instead of being
+   * copied. The input must outlive the tree, and such strings are not 
+   * '\0'-terminated: always pair GetString() with GetStringLength(). */
+  kPARSE_ZERO_COPY = 0x1,
+  /* Index the structural characters of the whole input with SIMD first,
+   * then build the tree from the index (see structural.h). Same results and
+   * status codes as the default parser; pays off on large inputs. */
+  kPARSE_TWO_STAGE = 0x2,
+  /* Parse the elements or members of a root array or object on several
+   * threads (see ParseContext::SetThreads), each from a piece of the input
+   * cut at a comma of the root, and join them into the one tree. Same
+   * results and status codes as the default parser: invalid input is
+   * parsed again on the calling thread to find the first error. Inputs
+   * below two JSONUTIL_PARALLEL_PIECE_SIZE pieces, other roots and
+   * ParseInsitu() ignore it. */
+  kPARSE_PARALLEL = 0x4,
+  /* Check with SIMD that the whole input is valid UTF-8 before parsing it,
+   * and fail with kJSON_PARSE_INVALID_UTF8 if not. Without it the bytes of
+   * strings are taken as they are. See also Validate() in validate.h. */
+  kPARSE_VALIDATE_UTF8 = 0x8
+} ParseFlag;
+
 class Member;
+class Key;
 template <class T>
 class Builder;
+struct ParseState;
+struct ParallelParse;
+class ParseContext;
+class StringPool;
+class ValueHandler;
 
 class Value {
  public:
-  Value(): val_({{NULL, 0}}), type_(kJSON_NULL) {
+  Value(): val_(), size_(0), tail_(), type_(kJSON_NULL), flags_(0) {
   }
-  explicit Value(ValueType t): val_({{NULL, 0}}), type_(t) {
+  explicit Value(ValueType t)
+    : val_(), size_(0), tail_(), type_(static_cast<uint8_t>(t)), flags_(0) {
   }
 
   Value(const Value& rhs);
   const Value& operator=(const Value&);
   ~Value();
 
-  JsonStatus Parse(const char* text, int len);
+  JsonStatus Parse(const char* text, int len, int flags = kPARSE_DEFAULT);
+  /* As above, with @stk as the scratch stack so that repeated parses reuse
+   * its memory. */
+  JsonStatus Parse(Stack& stk, const char* text, int len, int flags = kPARSE_DEFAULT);
+  /* As above, with every scratch buffer taken from @ctx. */
+  JsonStatus Parse(ParseContext& ctx, const char* text, int len, int flags = kPARSE_DEFAULT);
+  /* Destructive parse: strings are unescaped inside @text and the tree's
+   * strings and keys point into it, so @text must outlive the tree. */
+  JsonStatus ParseInsitu(char* text, int len);
 
   bool GetBoolean() const;
   void SetBoolean(bool b);
 
+  /* True for kJSON_NUMBER, kJSON_INT64 and kJSON_UINT64. */
+  bool IsNumber() const;
+  /* Any numeric type, converted to double. */
   double GetNumber() const;
   void SetNumber(double num);
+  int64_t GetInt64() const;
+  void SetInt64(int64_t num);
+  uint64_t GetUint64() const;
+  void SetUint64(uint64_t num);
 
+  /* Strings of up to 13 bytes are stored inside the Value itself, so the
+   * pointer is only good while the Value stays where it is. */
   char* GetString();
   const char* GetString() const;
   int GetStringLength() const;
@@ -63,15 +132,26 @@ class Value {
   const Value* GetValueByKey(const char* k, int len) const;
   Member* GetMemberByKey(const char* k, int len);
   const Member* GetMemberByKey(const char* k, int len) const;
+  /* Lookups with a prepared Key; same results as above. */
+  Value* GetValueByKey(const Key& key);
+  const Value* GetValueByKey(const Key& key) const;
+  Member* GetMemberByKey(const Key& key);
+  const Member* GetMemberByKey(const Key& key) const;
   void SetObject(const Value* src);
   bool SetObjectKeyValue(const char* k, int len, Value* v);
   void MergeObjectBuilder(Builder<Member>& b);
 
   void Reset(ValueType t = kJSON_NULL);
-  ValueType Type() const { return type_; }
+  ValueType Type() const { return static_cast<ValueType>(type_); }
   std::string ToString() const;
   
   friend Value& operator<<(Value& v, double num);
+  friend Value& operator<<(Value& v, int num);
+  friend Value& operator<<(Value& v, unsigned num);
+  friend Value& operator<<(Value& v, long num);
+  friend Value& operator<<(Value& v, unsigned long num);
+  friend Value& operator<<(Value& v, long long num);
+  friend Value& operator<<(Value& v, unsigned long long num);
   friend Value& operator<<(Value& v, const std::string& s);
   template <typename T>
   friend Value& operator<<(Value& v, const std::vector<T>& a);
@@ -79,44 +159,240 @@ class Value {
   friend Value& operator<<(Value& v, const std::map<std::string, T>& m);
 
   friend void operator>>(const Value& v, double& num);
+  friend void operator>>(const Value& v, int& num);
+  friend void operator>>(const Value& v, unsigned& num);
+  friend void operator>>(const Value& v, long& num);
+  friend void operator>>(const Value& v, unsigned long& num);
+  friend void operator>>(const Value& v, long long& num);
+  friend void operator>>(const Value& v, unsigned long long& num);
   friend void operator>>(const Value& v, std::string& s);
   template <typename T>
   friend void operator>>(const Value& v, std::vector<T>& a);
   template <typename T>
   friend void operator>>(const Value& v, std::map<std::string, T>& m);
 
+ protected:
+  JsonStatus ParseRoot(ParseState& ps, const char* text, int len);
+
  private:
+  friend class ValueHandler;
+  friend class Member;
+  friend struct ParallelParse;
+
+  /* The payload (string bytes, element or member block) is not owned by this
+   * Value, e.g. it lives in a Document's arena; Free() only forgets it. */
+  enum { kBORROWED = 0x1 };
+  /* A short string kept in the Value itself, from val_ over size_ and
+   * tail_, '\0'-terminated, with its length in the bits of flags_ from
+   * kINLINE_SHIFT up: no allocation at all. */
+  enum { kINLINE = 0x2, kINLINE_SHIFT = 4, kINLINE_MAX = 13 };
+
+  /* Make this a copy of @s[0, len), inline when short enough. */
+  bool AssignString(const char* s, int len);
+  /* Take over the payload of @src, which is left null; nothing is copied
+   * or freed besides what this Value held. */
+  void Take(Value& src);
+
   void Free();
-  void FreeOnError(Stack& s);
-  JsonStatus ParseObject(Stack& stk, Slice& s);
-  JsonStatus ParseValue(Stack& stk, Slice& s);
+  void FreeShallow(Stack& pending);
+  template <typename Cursor>
+  JsonStatus ParseTree(ParseState& ps, Cursor& cur);
+  /* kPARSE_PARALLEL; false if @text has to be parsed the usual way. */
+  bool ParseParallel(ParseState& ps, const char* text, int len);
   JsonStatus ParseLiteral(Slice& s, char c);
-  JsonStatus ParseString(Stack& stk, Slice& s);
-  JsonStatus ParseArray(Stack& stk, Slice& s);
+  JsonStatus ParseString(ParseState& ps, Slice& s);
   JsonStatus ParseNumber(Slice& s);
+  /* 16 bytes in all, so that an array element is a quarter cache line. */
   union {
-    struct {
-      Member* m;
-      int size;
-    } o; // object
-    struct {
-      Value* a;
-      int size;
-    } a; // array
-    struct {
-      char* s;
-      int len;
-    } s; // string
+    Member* m; // object
+    Value* a; // array
+    char* s; // string
     double num; // number
+    int64_t i64; // int64
+    uint64_t u64; // uint64
   } val_;
-  ValueType type_;
+  int size_; // members, elements or string bytes
+  char tail_[2]; // only the end of an inline string
+  uint8_t type_; // ValueType
+  uint8_t flags_;
 };
 
 bool Compare(const Value* lhs, const Value* rhs);
 
+/* A key prepared for repeated lookups, e.g. a static const Key kId("id").
+ * Its hash, length and first bytes are computed once, so that a lookup
+ * rejects most members without comparing bytes, and large objects are
+ * probed through their hash index without hashing the key again. The bytes
+ * are not copied: they must outlive the Key. */
+class Key {
+ public:
+  Key(const char* k, int len);
+  explicit Key(const char* k);
+  explicit Key(const std::string& k);
+
+  const char* Ptr() const { return k_; }
+  int Len() const { return len_; }
+  uint32_t Hash() const { return hash_; }
+  /* The first 8 bytes as stored in memory, or 0 for shorter keys. */
+  uint64_t Prefix() const { return prefix_; }
+
+ private:
+  const char* k_;
+  int len_;
+  uint32_t hash_;
+  uint64_t prefix_;
+};
+
+/* A Value whose whole tree (nodes, keys and strings) is carved out of one
+ * arena. Parsing does no per-node malloc and the tree is released by a single
+ * arena reset.
+ * Nodes inside the tree are read as usual, but setters that allocate (e.g.
+ * SetString or assignment) on them put heap memory the arena does not track;
+ * Reset() such nodes yourself before the Document is reset or destroyed. */
+class Document : public Value {
+ public:
+  Document() {
+  }
+  ~Document();
+
+  JsonStatus Parse(const char* text, int len, int flags = kPARSE_DEFAULT);
+  JsonStatus Parse(ParseContext& ctx, const char* text, int len, int flags = kPARSE_DEFAULT);
+  JsonStatus ParseInsitu(char* text, int len);
+  /* Parse the file at @path straight from a memory mapping of it, without
+   * reading it into a buffer first. With kPARSE_ZERO_COPY the mapping is
+   * kept until Reset() so that strings can refer into it; otherwise it is
+   * dropped once the tree is built. Fails with kJSON_FILE_IO_ERROR if the
+   * file cannot be mapped or is larger than INT_MAX bytes. */
+  JsonStatus ParseFile(const char* path, int flags = kPARSE_DEFAULT);
+  /* ParseInsitu() on a private, copy-on-write mapping of @path: the file
+   * itself is never modified and the mapping lives until Reset(). */
+  JsonStatus ParseFileInsitu(const char* path);
+  /* Release the tree, recycle the arena and unmap the file, if any. */
+  void Reset(ValueType t = kJSON_NULL);
+  Arena& GetArena() { return arena_; }
+
+ private:
+  /* Document is noncopyable. */
+  Document(const Document&);
+  const Document& operator=(const Document&);
+
+  /* Map @path into file_ and check that Parse() can take its length. */
+  JsonStatus MapFile(const char* path, bool writable);
+
+  Arena arena_;
+  MappedFile file_; /* the input of ParseFile*(), while the tree uses it */
+};
+
+/* The scratch buffers of a parse: the stack of pending values and decoded
+ * strings, and the structural index of kPARSE_TWO_STAGE. Passing the same
+ * context to every Parse keeps their capacity, so that a stream of small
+ * documents costs no scratch allocation after the first few. A context is
+ * used by one parse at a time; keep one per thread, e.g. thread_local. */
+class ParseContext {
+ public:
+  /* With a @pool, keys and short strings of the trees parsed through this
+   * context are interned in it instead of copied (see StringPool); it may
+   * be shared by several contexts. */
+  explicit ParseContext(StringPool* pool = NULL) : pool_(pool), threads_(0) {
+    memset(interned_, 0, sizeof(interned_));
+  }
+  /* Give the buffers back, e.g. after an unusually large document. */
+  void Release() {
+    stk_.Free();
+    index_.Free();
+  }
+  /* Bytes held across parses. */
+  int Capacity() const { return stk_.Size() + index_.Size(); }
+  void SetStringPool(StringPool* pool) {
+    pool_ = pool;
+    memset(interned_, 0, sizeof(interned_));
+  }
+  StringPool* GetStringPool() const { return pool_; }
+  /* Threads of a kPARSE_PARALLEL parse, the calling one included; 0 (the
+   * default, also used without a context) for one per CPU. */
+  void SetThreads(int threads) { threads_ = threads; }
+  int GetThreads() const { return threads_; }
+  /* StringPool::Intern() on the pool, through a small cache of this
+   * context's last hits; NULL without a pool. */
+  const char* Intern(const char* s, int len);
+
+ private:
+  /* ParseContext is noncopyable. */
+  ParseContext(const ParseContext&);
+  const ParseContext& operator=(const ParseContext&);
+
+  friend class Value;
+  friend class Document;
+
+  /* The strings this context last took from pool_, by hash, so that most
+   * keys are found without locking the pool. */
+  struct Interned {
+    const char* s;
+    int len;
+  };
+  enum { kINTERN_CACHE = 64 };
+
+  Stack stk_;
+  Stack index_;
+  StringPool* pool_;
+  int threads_;
+  Interned interned_[kINTERN_CACHE];
+};
+
+/* Event handler (see reader.h) that builds a tree from the events of a
+ * Reader or PushParser. @root is replaced once the whole value is complete;
+ * a partial tree left by a failed parse is released by Reset() or the
+ * destructor. */
+class ValueHandler {
+ public:
+  explicit ValueHandler(Value& root) : root_(root), depth_(0) {
+    memset(&cur_, 0, sizeof(cur_));
+  }
+  ~ValueHandler() {
+    Reset();
+  }
+
+  bool Null();
+  bool Bool(bool b);
+  bool Int64(int64_t i);
+  bool Uint64(uint64_t u);
+  bool Number(double d);
+  bool String(const char* s, int len);
+  bool StartObject();
+  bool Key(const char* s, int len);
+  bool EndObject(int size);
+  bool StartArray();
+  bool EndArray(int size);
+  /* Drop the partial tree of an unfinished parse. */
+  void Reset();
+
+ private:
+  /* ValueHandler is noncopyable. */
+  ValueHandler(const ValueHandler&);
+  const ValueHandler& operator=(const ValueHandler&);
+
+  /* An open container: its children are stk_[head, top) and, in an object,
+   * @key is the pending key of the next member. */
+  struct Frame {
+    int head;
+    bool object;
+    char* key;
+    int klen;
+  };
+
+  bool Place(Value& v);
+  bool Start(bool object);
+
+  Value& root_;
+  Stack stk_;    /* children of the open containers, innermost on top */
+  Stack frames_; /* Frames of the containers enclosing cur_ */
+  Frame cur_;
+  int depth_;
+};
+
 class Member {
  public:
-  Member() : k_(NULL), len_(0), v_(NULL) {
+  Member() : k_(NULL), len_(0), flags_(0) {
   }
 
   Member(const Member& rhs);
@@ -126,20 +402,30 @@ class Member {
   char* Key() { return k_; }
   const char* Key() const { return k_; }
   int KLen() const { return len_; }
-  Value* Val() { return v_; }
-  const Value* Val() const { return v_; }
+  Value* Val() { return &v_; }
+  const Value* Val() const { return &v_; }
   void SetKey(const char* k, int len);
   void SetValue(const Value* v);
   void Set(const char* k, int len, const Value* v);
-  /* Move the ownership of key-value to this object. */
+  /* Move the ownership of key-value to this object. The value is stored in
+   * the member itself: @v must be a malloc'd node, whose payload is taken
+   * over and which is then freed. */
   void MoveKey(const char* k, int len);
   void MoveValue(const Value* v);
   void Move(const char* k, int len, const Value* v);
   void Free();
  private:
+  friend class Value;
+  friend class ValueHandler;
+  /* The key bytes are not owned, see Value::kBORROWED. */
+  enum { kKEY_BORROWED = 0x1 };
+  void FreeKey();
+  void FreeValue();
+
   char* k_;
   int len_;
-  Value* v_;
+  int flags_;
+  Value v_; /* inline: a member is 32 bytes and needs no node of its own */
 };
 
 template <class T>
@@ -174,13 +460,28 @@ class Builder {
 };
 
 Value& operator<<(Value& v, double num);
+Value& operator<<(Value& v, int num);
+Value& operator<<(Value& v, unsigned num);
+Value& operator<<(Value& v, long num);
+Value& operator<<(Value& v, unsigned long num);
+Value& operator<<(Value& v, long long num);
+Value& operator<<(Value& v, unsigned long long num);
 Value& operator<<(Value& v, const std::string& s);
 template <typename T>
 Value& operator<<(Value& v, const std::vector<T>& a);
 template <typename T>
 Value& operator<<(Value& v, const std::map<std::string, T>& m);
 
+/* The integer targets take any numeric type (kJSON_INT64, kJSON_UINT64, or
+ * kJSON_NUMBER such as 3.0) whose value is integral and fits the target;
+ * anything else asserts. */
 void operator>>(const Value& v, double& num);
+void operator>>(const Value& v, int& num);
+void operator>>(const Value& v, unsigned& num);
+void operator>>(const Value& v, long& num);
+void operator>>(const Value& v, unsigned long& num);
+void operator>>(const Value& v, long long& num);
+void operator>>(const Value& v, unsigned long long& num);
 void operator>>(const Value& v, std::string& s);
 template <typename T>
 void operator>>(const Value& v, std::vector<T>& a);
@@ -218,10 +519,8 @@ Value& operator<<(Value& v, const std::map<std::string, T>& m) {
   for (typename std::map<std::string, T>::const_iterator 
     it = m.cbegin(); it != m.cend(); ++it) {
     Member* p = batch.Push();
-    Value* vp = reinterpret_cast<Value*>(calloc(sizeof(v), 1));
-    (*vp) << (it->second);
+    (*p->Val()) << (it->second);
     p->SetKey((it->first).c_str(), static_cast<int>((it->first).size()));
-    p->MoveValue(vp);
   }
   v.MergeObjectBuilder(batch);
   return v;
@@ -244,13 +543,16 @@ template <typename T>
 void operator>>(const Value& v, std::map<std::string, T>& m) {
   assert(v.Type() == kJSON_OBJECT);
   int size = v.GetObjectSize();
+  /* Members come sorted by key, so the end of @m is usually the right spot. */
+  typename std::map<std::string, T>::iterator hint = m.end();
   for (int i = 0; i < size; ++i) {
     const Member* p = v.GetObjectMember(i);
-    const char* k = p->Key();
-    int len = p->KLen();
     T elem;
     (*(p->Val())) >> elem;
-    m[std::string(k, len)] = elem;
+    size_t before = m.size();
+    hint = m.insert(hint, std::make_pair(std::string(p->Key(), p->KLen()), elem));
+    if (m.size() == before) hint->second = elem; // a duplicate key: the last one wins
+    ++hint;
   }
 }
 
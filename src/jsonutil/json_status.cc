@@ -22,7 +22,12 @@ const char* status_string[] = {
   "Json parse object missing colon",                   // kJSON_PARSE_OBJECT_MISSING_COLON,
   "Json parse object invalid extra comma",             // kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA,
   "Json parse object missing comma or curly bracket",  // kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET,
-  "Json out of memory"                                 // kJSON_OUT_OF_MEMORY
+  "Json out of memory",                                // kJSON_OUT_OF_MEMORY
+  "Json parse handler aborted",                        // kJSON_PARSE_HANDLER_ABORTED
+  "Json parse max depth exceeded",                     // kJSON_PARSE_MAX_DEPTH_EXCEEDED
+  "Json file io error",                                // kJSON_FILE_IO_ERROR
+  "Json parse invalid utf8",                           // kJSON_PARSE_INVALID_UTF8
+  "Json write aborted"                                 // kJSON_WRITE_ABORTED
 };
 }
 
@@ -5,6 +5,12 @@
 
 #include <string>
 
+/* Containers nested deeper than this make the parsers fail with
+ * kJSON_PARSE_MAX_DEPTH_EXCEEDED. */
+#ifndef JSONUTIL_PARSE_MAX_DEPTH
+  #define JSONUTIL_PARSE_MAX_DEPTH 1024
+#endif
+
 namespace jsonutil {
 
 class JsonStatus {
@@ -28,11 +34,16 @@ class JsonStatus {
     kJSON_PARSE_OBJECT_MISSING_COLON,
     kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA,
     kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET,
-    kJSON_OUT_OF_MEMORY
+    kJSON_OUT_OF_MEMORY,
+    kJSON_PARSE_HANDLER_ABORTED,
+    kJSON_PARSE_MAX_DEPTH_EXCEEDED,
+    kJSON_FILE_IO_ERROR,
+    kJSON_PARSE_INVALID_UTF8,
+    kJSON_WRITE_ABORTED
   } Status;
 
   JsonStatus(Status s = kJSON_OK): status_(s) { 
-    assert(s >= kJSON_OK && s <= kJSON_OUT_OF_MEMORY);
+    assert(s >= kJSON_OK && s <= kJSON_WRITE_ABORTED);
   }
  
   bool operator==(const JsonStatus& rhs) { return status_ == rhs.status_; }
@@ -0,0 +1,259 @@
+#include "lazy.h"
+#include "simd.h"
+#include "number.h"
+#include "decode.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace jsonutil {
+
+namespace {
+
+inline bool EndsScalar(char c) {
+  switch (c) {
+    case ' ':  case '\t': case '\r': case '\n': case '\0':
+    case '{':  case '}':  case '[':  case ']':  case ':':  case ',':
+    case '\"': return true;
+    default:   return false;
+  }
+}
+
+/* Past the closing quote of the string whose body starts at @p, or NULL
+ * if it is not closed. Escapes are stepped over, not checked. */
+const char* SkipString(const char* p, const char* end) {
+  while (true) {
+    p = ScanStringRun(p, end);
+    if (p == end) return NULL;
+    if (*p == '\"') return p + 1;
+    p += (*p == '\\') ? 2 : 1;
+    if (p > end) return NULL;
+  }
+}
+
+/* Past the value at @p by bracket matching, or NULL if it is cut short. */
+const char* SkipValue(const char* p, const char* end) {
+  if (p == end) return NULL;
+  char c = *p;
+  if (c == '\"') return SkipString(p + 1, end);
+  if (c != '[' && c != '{') {
+    const char* q = p;
+    while (q < end && !EndsScalar(*q)) ++q;
+    return q == p ? NULL : q;
+  }
+  int depth = 0;
+  while (p < end) {
+    c = *p;
+    if (c == '\"') {
+      p = SkipString(p + 1, end);
+      if (p == NULL) return NULL;
+      continue;
+    }
+    if (c == '[' || c == '{') {
+      ++depth;
+    } else if ((c == ']' || c == '}') && --depth == 0) {
+      return p + 1;
+    }
+    ++p;
+  }
+  return NULL;
+}
+
+/* Accepts every event, for Diagnose. */
+struct NullHandler : public BaseHandler<NullHandler> {
+};
+
+} // static-function namespace
+
+JsonStatus LazyDocument::Parse(const char* text, int len) {
+  assert(text != NULL && len >= 0);
+  text_ = NULL;
+  len_ = 0;
+  root_ = 0;
+  arena_.Reset();
+  const char* p = SkipWhitespace(text, text + len);
+  if (p == text + len) return JsonStatus::kJSON_PARSE_EXPECT_VALUE;
+  text_ = text;
+  len_ = len;
+  root_ = static_cast<int>(p - text);
+  return JsonStatus::kJSON_OK;
+}
+
+JsonStatus LazyDocument::Diagnose(const char* p) {
+  NullHandler h;
+  JsonStatus ret = reader_.Parse(p, static_cast<int>(text_ + len_ - p), h);
+  assert(ret != JsonStatus::kJSON_OK);
+  return ret;
+}
+
+/* [p, end) is the value and whatever follows it. */
+JsonStatus LazyValue::Begin(const char*& p, const char*& end) const {
+  assert(Valid());
+  p = doc_->text_ + pos_;
+  end = doc_->text_ + doc_->len_;
+  if (p == end || *p == '\0') return JsonStatus::kJSON_PARSE_EXPECT_VALUE;
+  return JsonStatus::kJSON_OK;
+}
+
+ValueType LazyValue::Type() const {
+  assert(Valid());
+  const char* p = doc_->text_ + pos_;
+  if (p == doc_->text_ + doc_->len_) return kJSON_NULL;
+  switch (*p) {
+    case 'n':  return kJSON_NULL;
+    case 't':  return kJSON_TRUE;
+    case 'f':  return kJSON_FALSE;
+    case '\"': return kJSON_STRING;
+    case '[':  return kJSON_ARRAY;
+    case '{':  return kJSON_OBJECT;
+    default:   return kJSON_NUMBER;
+  }
+}
+
+JsonStatus LazyValue::GetBoolean(bool& b) const {
+  const char* p;
+  const char* end;
+  JsonStatus ret = Begin(p, end);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  assert(*p == 't' || *p == 'f');
+  if (end - p >= 4 && memcmp(p, "true", 4) == 0) {
+    b = true;
+  } else if (end - p >= 5 && memcmp(p, "false", 5) == 0) {
+    b = false;
+  } else {
+    return JsonStatus::kJSON_PARSE_INVALID_VALUE;
+  }
+  return ret;
+}
+
+JsonStatus LazyValue::GetNumber(double& d) const {
+  const char* p;
+  const char* end;
+  JsonStatus ret = Begin(p, end);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  Slice s(p, static_cast<int>(end - p));
+  Number num;
+  ret = ScanNumber(s, num);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  switch (num.kind) {
+    case Number::kINT64:  d = static_cast<double>(num.val.i64); break;
+    case Number::kUINT64: d = static_cast<double>(num.val.u64); break;
+    default:              d = num.val.d;
+  }
+  return ret;
+}
+
+JsonStatus LazyValue::GetString(const char*& str, int& len) const {
+  const char* p;
+  const char* end;
+  JsonStatus ret = Begin(p, end);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  assert(*p == '\"');
+  Slice s(p, static_cast<int>(end - p));
+  len = ScanPlainString(s);
+  if (len >= 0) {
+    str = p + 1;
+    return ret;
+  }
+  Stack& stk = doc_->stk_;
+  ret = ParseStringInStack(stk, s, len);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  char* dst = static_cast<char*>(doc_->arena_.Allocate(len + 1));
+  if (dst == NULL) return JsonStatus::kJSON_OUT_OF_MEMORY;
+  memcpy(dst, stk.Pop(len), len);
+  dst[len] = '\0';
+  str = dst;
+  return ret;
+}
+
+JsonStatus LazyValue::GetValue(Value& v) const {
+  const char* p;
+  const char* end;
+  JsonStatus ret = Begin(p, end);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  const char* q = SkipValue(p, end);
+  if (q == NULL) return doc_->Diagnose(p);
+  return v.Parse(doc_->stk_, p, static_cast<int>(q - p));
+}
+
+JsonStatus LazyValue::GetArraySize(int& size) const {
+  assert(Type() == kJSON_ARRAY);
+  LazyValue v;
+  return Walk(-1, NULL, 0, size, v);
+}
+
+JsonStatus LazyValue::GetArrayValue(int index, LazyValue& v) const {
+  assert(Type() == kJSON_ARRAY && index >= 0);
+  int count = 0;
+  v = LazyValue();
+  return Walk(index, NULL, 0, count, v);
+}
+
+JsonStatus LazyValue::GetObjectSize(int& size) const {
+  assert(Type() == kJSON_OBJECT);
+  LazyValue v;
+  return Walk(-1, NULL, 0, size, v);
+}
+
+JsonStatus LazyValue::GetValueByKey(const char* k, int len, LazyValue& v) const {
+  assert(Type() == kJSON_OBJECT && k != NULL);
+  int count = 0;
+  v = LazyValue();
+  return Walk(-1, k, len, count, v);
+}
+
+/* Mirrors Value::ParseArray and Value::ParseObject, with SkipValue in place
+ * of ParseValue for the children that are not wanted. */
+JsonStatus LazyValue::Walk(int index, const char* k, int klen,
+                           int& count, LazyValue& v) const {
+  const char* p = doc_->text_ + pos_;
+  const char* end = doc_->text_ + doc_->len_;
+  bool object = (*p == '{');
+  char close = object ? '}' : ']';
+  count = 0;
+  p = SkipWhitespace(p + 1, end);
+  if (p < end && *p == close) return JsonStatus::kJSON_OK;
+  while (true) {
+    bool match = (count == index);
+    if (object) {
+      p = SkipWhitespace(p, end);
+      if (p == end || *p != '\"') return JsonStatus::kJSON_PARSE_OBJECT_MISSING_KEY;
+      Slice s(p, static_cast<int>(end - p));
+      const char* key = p + 1;
+      int len = ScanPlainString(s);
+      if (len >= 0) {
+        p += len + 2;
+      } else {
+        JsonStatus ret = ParseStringInStack(doc_->stk_, s, len);
+        if (ret != JsonStatus::kJSON_OK) return ret;
+        key = doc_->stk_.Pop(len);
+        p = s.Ptr();
+      }
+      if (k) match = (len == klen && memcmp(key, k, len) == 0);
+      p = SkipWhitespace(p, end);
+      if (p == end || *p != ':') return JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON;
+      ++p;
+    }
+    p = SkipWhitespace(p, end);
+    if (match) {
+      v = LazyValue(doc_, static_cast<int>(p - doc_->text_));
+      return JsonStatus::kJSON_OK;
+    }
+    const char* q = SkipValue(p, end);
+    if (q == NULL) return doc_->Diagnose(p);
+    ++count;
+    p = SkipWhitespace(q, end);
+    if (p < end && *p == close) return JsonStatus::kJSON_OK;
+    if (p == end || *p != ',') {
+      return object ? JsonStatus::kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET
+                    : JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA;
+    }
+    p = SkipWhitespace(p + 1, end);
+    if (p < end && *p == close) {
+      return object ? JsonStatus::kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA
+                    : JsonStatus::kJSON_PARSE_ARRAY_INVALID_EXTRA_COMMA;
+    }
+  }
+}
+
+} // namespace jsonutil
@@ -0,0 +1,91 @@
+#ifndef JSONUTIL_SRC_LAZY_H__
+#define JSONUTIL_SRC_LAZY_H__
+
+#include "json.h"
+#include "arena.h"
+#include "stack.h"
+#include "reader.h"
+#include "json_status.h"
+
+namespace jsonutil {
+class LazyDocument;
+
+/* A value inside a LazyDocument, not yet decoded: a position in the input.
+ * It is two words and is passed by value. Accessors scan only what they
+ * need and return the same JsonStatus as Value::Parse for errors they run
+ * into; siblings they step over are only bracket-matched, so errors inside
+ * those go unnoticed until the siblings are read. */
+class LazyValue {
+ public:
+  LazyValue() : doc_(NULL), pos_(0) {
+  }
+
+  /* False for the result of a lookup that found nothing. */
+  bool Valid() const { return doc_ != NULL; }
+  /* Guessed from the first byte: numbers are all kJSON_NUMBER and invalid
+   * input may look like anything. */
+  ValueType Type() const;
+
+  JsonStatus GetBoolean(bool& b) const;
+  JsonStatus GetNumber(double& d) const;
+  /* Escape-free strings point into the input and are not '\0'-terminated;
+   * others are decoded into the document's arena. */
+  JsonStatus GetString(const char*& s, int& len) const;
+  /* Decode the whole subtree into @v. */
+  JsonStatus GetValue(Value& v) const;
+
+  JsonStatus GetArraySize(int& size) const;
+  /* @v is left invalid when @index is out of range. */
+  JsonStatus GetArrayValue(int index, LazyValue& v) const;
+  JsonStatus GetObjectSize(int& size) const;
+  /* The first member named @k; @v is left invalid if there is none. */
+  JsonStatus GetValueByKey(const char* k, int len, LazyValue& v) const;
+
+ private:
+  friend class LazyDocument;
+  LazyValue(LazyDocument* d, int p) : doc_(d), pos_(p) {
+  }
+
+  /* Steps over the children until the @index-th one (arrays and objects)
+   * or the first member named @k (objects, when @k is not NULL); @count is
+   * the number of children stepped over. */
+  JsonStatus Walk(int index, const char* k, int klen,
+                  int& count, LazyValue& v) const;
+  JsonStatus Begin(const char*& p, const char*& end) const;
+
+  LazyDocument* doc_;
+  int pos_;
+};
+
+/* On-demand parser for reading a few fields out of large documents. Parse()
+ * only finds the root; the values are scanned when asked for through
+ * LazyValue. Nothing after the root value is checked.
+ * @text must outlive the document and the values taken from it. */
+class LazyDocument {
+ public:
+  LazyDocument() : text_(NULL), len_(0), root_(0) {
+  }
+
+  JsonStatus Parse(const char* text, int len);
+  LazyValue Root() { return text_ ? LazyValue(this, root_) : LazyValue(); }
+
+ private:
+  /* LazyDocument is noncopyable. */
+  LazyDocument(const LazyDocument&);
+  const LazyDocument& operator=(const LazyDocument&);
+
+  friend class LazyValue;
+
+  /* Error of the value at @p that a bracket match could not step over. */
+  JsonStatus Diagnose(const char* p);
+
+  const char* text_;
+  int len_;
+  int root_;
+  Stack stk_;     /* scratch for escaped keys */
+  Arena arena_;   /* strings decoded by GetString */
+  Reader reader_; /* for Diagnose */
+};
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_LAZY_H__
@@ -0,0 +1,46 @@
+#include "mapped_file.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace jsonutil {
+
+bool MappedFile::Open(const char* path, bool writable) {
+  assert(path != NULL);
+  Close();
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return true;
+  }
+  int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  size_t size = static_cast<size_t>(st.st_size);
+  void* p = mmap(NULL, size, prot, flags, fd, 0);
+  close(fd); // the mapping keeps its own reference
+  if (p == MAP_FAILED) return false;
+  madvise(p, size, MADV_SEQUENTIAL);
+  data_ = static_cast<char*>(p);
+  size_ = size;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_) munmap(data_, size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+} // namespace jsonutil
@@ -0,0 +1,36 @@
+#ifndef JSONUTIL_SRC_MAPPED_FILE_H__
+#define JSONUTIL_SRC_MAPPED_FILE_H__
+
+#include <stddef.h>
+
+namespace jsonutil {
+/* A whole file mapped into memory, read-only or copy-on-write. The mapping
+ * lives until Close() or the destructor. */
+class MappedFile {
+ public:
+  MappedFile() : data_(NULL), size_(0) {
+  }
+
+  ~MappedFile() {
+    Close();
+  }
+  /* Map @path, pre-faulted and advised for sequential reading. With
+   * @writable the pages are private: writes never reach the file. Returns
+   * false if the file cannot be opened or mapped. An empty file maps to
+   * Data() == NULL and Size() == 0. */
+  bool Open(const char* path, bool writable = false);
+  void Close();
+  char* Data() const { return data_; }
+  size_t Size() const { return size_; }
+
+ private:
+  /* MappedFile is noncopyable. */
+  MappedFile(const MappedFile&);
+  const MappedFile& operator=(const MappedFile&);
+
+  char* data_;
+  size_t size_;
+};
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_MAPPED_FILE_H__
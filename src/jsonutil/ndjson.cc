@@ -0,0 +1,253 @@
+#include "ndjson.h"
+#include "simd.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jsonutil {
+
+/* Per-thread scratch: the parser's buffers and the documents of a chunk. */
+struct NdjsonReader::Worker {
+  ParseContext scratch;
+  Stack docs;
+};
+
+namespace {
+
+struct Chunk {
+  const char* begin;
+  const char* end;
+  Value* docs;        /* malloc'd, handed over on delivery */
+  int num;
+  JsonStatus status;
+  int64_t lines;      /* lines in the chunk */
+  int64_t error_line; /* 1-based within the chunk */
+  bool done;
+};
+
+/* Cut [text, text + len) after the first '\n' past every chunk size. */
+void SplitChunks(const char* text, size_t len, std::vector<Chunk>& chunks) {
+  const char* p = text;
+  const char* end = text + len;
+  while (p < end) {
+    const char* q = end;
+    if (static_cast<size_t>(end - p) > JSONUTIL_NDJSON_CHUNK_SIZE) {
+      q = p + JSONUTIL_NDJSON_CHUNK_SIZE;
+      const char* nl = static_cast<const char*>(memchr(q, '\n', end - q));
+      q = nl ? nl + 1 : end;
+    }
+    Chunk c;
+    c.begin = p;
+    c.end = q;
+    c.docs = NULL;
+    c.num = 0;
+    c.lines = 0;
+    c.error_line = 0;
+    c.done = false;
+    chunks.push_back(c);
+    p = q;
+  }
+}
+
+void FreeDocs(Value* docs, int num) {
+  for (int i = 0; i < num; ++i) {
+    docs[i].Reset();
+  }
+  free(docs);
+}
+
+void ParseChunk(ParseContext& scratch, Stack& out, Chunk& c, int flags) {
+  const char* p = c.begin;
+  int64_t line = 0;
+  while (p < c.end) {
+    const char* nl = static_cast<const char*>(memchr(p, '\n', c.end - p));
+    const char* eol = nl ? nl : c.end;
+    ++line;
+    if (SkipWhitespace(p, eol) != eol) {
+      assert(eol - p <= INT_MAX);
+      char* slot = out.Push(sizeof(Value));
+      memset(slot, 0, sizeof(Value));
+      Value* v = reinterpret_cast<Value*>(slot);
+      JsonStatus ret = v->Parse(scratch, p, static_cast<int>(eol - p), flags);
+      if (ret != JsonStatus::kJSON_OK) {
+        out.Pop(sizeof(Value));
+        c.status = ret;
+        c.error_line = line;
+        break;
+      }
+    }
+    p = nl ? nl + 1 : c.end;
+  }
+  c.lines = line;
+
+  int bytes = out.Top();
+  c.num = bytes / static_cast<int>(sizeof(Value));
+  if (c.num == 0) return;
+  c.docs = static_cast<Value*>(malloc(bytes));
+  Value* src = reinterpret_cast<Value*>(out.Pop(bytes));
+  if (c.docs == NULL) {
+    for (int i = 0; i < c.num; ++i) src[i].Reset();
+    c.num = 0;
+    c.status = JsonStatus::kJSON_OUT_OF_MEMORY;
+    return;
+  }
+  memcpy(static_cast<void*>(c.docs), src, bytes);
+}
+
+/* Chunks are claimed in order by the workers, at most @window ahead of the
+ * one being delivered so that memory stays bounded. */
+struct Schedule {
+  Schedule(std::vector<Chunk>& c, int f, int w)
+    : chunks(c), flags(f), window(w), next(0), delivered(0), stop(false) {
+  }
+
+  std::vector<Chunk>& chunks;
+  int flags;
+  size_t window;
+  size_t next;
+  size_t delivered;
+  bool stop;
+  std::mutex mu;
+  std::condition_variable cv;
+};
+
+void WorkerMain(Schedule* s, ParseContext* scratch, Stack* out) {
+  std::unique_lock<std::mutex> lock(s->mu);
+  while (true) {
+    while (!s->stop && s->next < s->chunks.size()
+           && s->next >= s->delivered + s->window) {
+      s->cv.wait(lock);
+    }
+    if (s->stop || s->next >= s->chunks.size()) return;
+    Chunk& c = s->chunks[s->next++];
+    lock.unlock();
+    ParseChunk(*scratch, *out, c, s->flags);
+    lock.lock();
+    c.done = true;
+    s->cv.notify_all();
+  }
+}
+
+/* Hand the documents of @c over to @batch or @cb. */
+JsonStatus Deliver(Chunk& c, Builder<Value>* batch, NdjsonCallback cb, void* arg) {
+  JsonStatus ret = c.status;
+  for (int i = 0; i < c.num; ++i) {
+    if (batch) {
+      memcpy(static_cast<void*>(batch->Push()), c.docs + i, sizeof(Value));
+      continue;
+    }
+    bool ok = cb(c.docs[i], arg);
+    c.docs[i].Reset();
+    if (!ok) {
+      while (++i < c.num) c.docs[i].Reset();
+      ret = JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+      break;
+    }
+  }
+  free(c.docs);
+  c.docs = NULL;
+  c.num = 0;
+  return ret;
+}
+
+} // static-function namespace
+
+NdjsonReader::NdjsonReader(int threads, int flags)
+  : threads_(threads), flags_(flags), workers_(NULL), error_line_(0) {
+  if (threads_ <= 0) threads_ = static_cast<int>(std::thread::hardware_concurrency());
+  if (threads_ <= 0) threads_ = 1;
+  workers_ = new Worker[threads_];
+}
+
+NdjsonReader::~NdjsonReader() {
+  delete[] workers_;
+}
+
+void NdjsonReader::SetStringPool(StringPool* pool) {
+  for (int i = 0; i < threads_; ++i) {
+    workers_[i].scratch.SetStringPool(pool);
+  }
+}
+
+JsonStatus NdjsonReader::Parse(const char* text, size_t len, Value& docs) {
+  Builder<Value> batch;
+  docs.Reset();
+  JsonStatus ret = Run(text, len, &batch, NULL, NULL);
+  if (ret != JsonStatus::kJSON_OK) {
+    int num = 0;
+    Value* p = batch.Dump(num);
+    for (int i = 0; i < num; ++i) p[i].Reset();
+    return ret;
+  }
+  docs.Reset(kJSON_ARRAY);
+  docs.MergeArrayBuilder(batch);
+  return ret;
+}
+
+JsonStatus NdjsonReader::Parse(const char* text, size_t len,
+                               NdjsonCallback cb, void* arg) {
+  assert(cb != NULL);
+  return Run(text, len, NULL, cb, arg);
+}
+
+JsonStatus NdjsonReader::Run(const char* text, size_t len, Builder<Value>* batch,
+                             NdjsonCallback cb, void* arg) {
+  assert(text != NULL || len == 0);
+  error_line_ = 0;
+  std::vector<Chunk> chunks;
+  SplitChunks(text, len, chunks);
+  int threads = threads_;
+  if (static_cast<size_t>(threads) > chunks.size()) {
+    threads = static_cast<int>(chunks.size());
+  }
+
+  JsonStatus ret;
+  int64_t line = 0;
+  size_t i = 0;
+  if (threads <= 1) {
+    for (; i < chunks.size() && ret == JsonStatus::kJSON_OK; ++i) {
+      ParseChunk(workers_[0].scratch, workers_[0].docs, chunks[i], flags_);
+      ret = Deliver(chunks[i], batch, cb, arg);
+      if (chunks[i].error_line) error_line_ = line + chunks[i].error_line;
+      line += chunks[i].lines;
+    }
+    return ret;
+  }
+
+  Schedule s(chunks, flags_, 2 * threads);
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.push_back(std::thread(WorkerMain, &s,
+                               &workers_[t].scratch, &workers_[t].docs));
+  }
+  for (; i < chunks.size() && ret == JsonStatus::kJSON_OK; ++i) {
+    {
+      std::unique_lock<std::mutex> lock(s.mu);
+      while (!chunks[i].done) s.cv.wait(lock);
+    }
+    ret = Deliver(chunks[i], batch, cb, arg);
+    if (chunks[i].error_line) error_line_ = line + chunks[i].error_line;
+    line += chunks[i].lines;
+    std::unique_lock<std::mutex> lock(s.mu);
+    s.delivered = i + 1;
+    if (ret != JsonStatus::kJSON_OK) s.stop = true;
+    s.cv.notify_all();
+  }
+  for (size_t t = 0; t < pool.size(); ++t) {
+    pool[t].join();
+  }
+  /* Chunks parsed ahead of an error. */
+  for (; i < chunks.size(); ++i) {
+    if (chunks[i].docs) FreeDocs(chunks[i].docs, chunks[i].num);
+  }
+  return ret;
+}
+
+} // namespace jsonutil
@@ -0,0 +1,58 @@
+#ifndef JSONUTIL_SRC_NDJSON_H__
+#define JSONUTIL_SRC_NDJSON_H__
+
+#include "json.h"
+#include "json_status.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef JSONUTIL_NDJSON_CHUNK_SIZE
+  #define JSONUTIL_NDJSON_CHUNK_SIZE (1 << 20)
+#endif
+
+namespace jsonutil {
+/* Called with each document in input order, on the thread that called
+ * NdjsonReader::Parse. @doc is released after the call, so copy what you
+ * need. Return false to stop the parse with kJSON_PARSE_HANDLER_ABORTED. */
+typedef bool (*NdjsonCallback)(Value& doc, void* arg);
+
+/* Parser for newline-delimited JSON (one document per line). The input is
+ * cut into newline-aligned chunks of about JSONUTIL_NDJSON_CHUNK_SIZE bytes
+ * that a pool of threads parses concurrently; documents come out in input
+ * order. Lines holding only whitespace are skipped. */
+class NdjsonReader {
+ public:
+  /* @threads is the number of workers, 0 for one per CPU. @flags are the
+   * ParseFlag bits for every line. */
+  explicit NdjsonReader(int threads = 0, int flags = kPARSE_DEFAULT);
+  ~NdjsonReader();
+
+  /* @docs becomes an array of the documents. On error it is left null. */
+  JsonStatus Parse(const char* text, size_t len, Value& docs);
+  /* Documents parsed before an error are still handed to @cb. */
+  JsonStatus Parse(const char* text, size_t len, NdjsonCallback cb, void* arg);
+  /* Intern the keys (and short strings) of every document in @pool, which
+   * must outlive them; NULL to stop. See StringPool. */
+  void SetStringPool(StringPool* pool);
+  /* 1-based line of the error returned by the last Parse, else 0. */
+  int64_t ErrorLine() const { return error_line_; }
+
+ private:
+  /* NdjsonReader is noncopyable. */
+  NdjsonReader(const NdjsonReader&);
+  const NdjsonReader& operator=(const NdjsonReader&);
+
+  struct Worker;
+
+  JsonStatus Run(const char* text, size_t len, Builder<Value>* batch,
+                 NdjsonCallback cb, void* arg);
+
+  int threads_;
+  int flags_;
+  Worker* workers_; /* scratch stacks, reused across Parse calls */
+  int64_t error_line_;
+};
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_NDJSON_H__
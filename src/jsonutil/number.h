@@ -0,0 +1,39 @@
+#ifndef JSONUTIL_SRC_NUMBER_H__
+#define JSONUTIL_SRC_NUMBER_H__
+
+#include "slice.h"
+#include "json_status.h"
+
+#include <stdint.h>
+
+namespace jsonutil {
+/* Result of ScanNumber. Integral literals that fit in 64 bits keep their
+ * exact value; everything else (and "-0") is a double. */
+struct Number {
+  typedef enum { kDOUBLE, kINT64, kUINT64 } Kind;
+
+  Kind kind;
+  union {
+    double d;
+    int64_t i64;
+    uint64_t u64; /* only used above INT64_MAX */
+  } val;
+};
+
+/* Parses the number at the start of @s in a single pass and advances @s past
+ * it. The conversion is exact (correctly rounded) and locale-independent.
+ * Returns kJSON_PARSE_INVALID_VALUE if @s doesn't start with a number, and
+ * kJSON_PARSE_NUMBER_OVERFLOW/UNDERFLOW if the value is out of range. */
+JsonStatus ScanNumber(Slice& s, Number& num);
+
+/* Writes the finite @d to @buf, which must hold 32 bytes, and returns the
+ * length. The digits are the shortest (in all but rare cases) that
+ * ScanNumber reads back as exactly @d, found with Grisu2 (Loitsch,
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers").
+ * Plain decimals up to 21 integer digits or 5 leading zeros after the
+ * point, e.g. "0.1", "-2500" or "0.00001"; else "1.5e300" or "2e-7".
+ * Locale-independent. */
+int WriteDouble(double d, char* buf);
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_NUMBER_H__
@@ -0,0 +1,378 @@
+#ifndef JSONUTIL_SRC_PUSH_PARSER_H__
+#define JSONUTIL_SRC_PUSH_PARSER_H__
+
+#include "stack.h"
+#include "slice.h"
+#include "simd.h"
+#include "number.h"
+#include "decode.h"
+#include "json_status.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace jsonutil {
+/* Incremental parser: the document is pushed in chunks of any size with
+ * Feed() and ended with Finish(). Events go to a handler as with Reader (see
+ * reader.h); use a ValueHandler to get a Value tree instead.
+ *
+ * Tokens that lie inside one chunk are decoded straight from it. Only a
+ * string or number split by a chunk boundary is copied, into a buffer the
+ * parser keeps across documents. Each call returns kJSON_OK so far or the
+ * first error, which sticks until Reset(); the status codes are those
+ * Value::Parse gives for the concatenated input. */
+template <typename Handler>
+class PushParser {
+ public:
+  explicit PushParser(Handler& h) : h_(h) {
+    Reset();
+  }
+
+  JsonStatus Feed(const char* text, int len);
+  /* The end of the input. */
+  JsonStatus Finish();
+  /* Start over with a new document; the handler is left alone. */
+  void Reset();
+
+ private:
+  /* PushParser is noncopyable. */
+  PushParser(const PushParser&);
+  const PushParser& operator=(const PushParser&);
+
+  typedef enum {
+    kVALUE,        /* a value is expected */
+    kARRAY_FIRST,  /* after '[' */
+    kOBJECT_FIRST, /* after '{' */
+    kKEY,          /* a key is expected */
+    kCOLON,        /* after a key */
+    kAFTER_VALUE,  /* after a value: ',', the closing bracket or the end */
+    kARRAY_NEXT,   /* after ',' in an array */
+    kOBJECT_NEXT,  /* after ',' in an object */
+    kSTRING,       /* inside a string or key */
+    kNUMBER,       /* inside a number */
+    kLITERAL       /* inside null, true or false */
+  } State;
+
+  static bool IsNumberChar(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+'
+           || c == '.' || c == 'e' || c == 'E';
+  }
+
+  const char* Step(const char* p);
+  const char* StartValue(const char* p);
+  const char* ContinueString(const char* p, const char* end);
+  const char* ContinueNumber(const char* p, const char* end);
+  const char* ContinueLiteral(const char* p, const char* end);
+  Slice TokenUntil(const char* end);
+  void EndString(const char* end);
+  void EndNumber(const char* end);
+  void EndValue(bool ok);
+  void EndContainer(bool object);
+  void Fail(JsonStatus::Status s) { status_ = s; }
+
+  Handler& h_;
+  JsonStatus status_;
+  State state_;
+  const char* tok_;    /* start of the current token in this chunk */
+  bool key_;           /* the string being read is a key */
+  bool escape_;        /* the chunk ended right after a '\\' */
+  const char* lit_;    /* the literal being matched, and how far */
+  int lit_pos_;
+  int depth_;          /* open containers */
+  bool in_object_;     /* the innermost one is an object */
+  int count_;          /* values seen so far in the innermost container */
+  Stack nest_;         /* count_ and in_object_ of the enclosing containers */
+  Stack token_;        /* raw bytes of a token split across chunks */
+  Stack scratch_;      /* decoded strings */
+};
+
+template <typename Handler>
+void PushParser<Handler>::Reset() {
+  status_ = JsonStatus::kJSON_OK;
+  state_ = kVALUE;
+  tok_ = NULL;
+  key_ = false;
+  escape_ = false;
+  lit_ = NULL;
+  lit_pos_ = 0;
+  depth_ = 0;
+  in_object_ = false;
+  count_ = 0;
+  nest_.Pop(nest_.Top());
+  token_.Pop(token_.Top());
+  scratch_.Pop(scratch_.Top());
+}
+
+template <typename Handler>
+JsonStatus PushParser<Handler>::Feed(const char* text, int len) {
+  assert(text != NULL || len == 0);
+  const char* p = text;
+  const char* end = text + len;
+  tok_ = p; // a split token continues at the start of the chunk
+  while (p < end && status_.Ok()) {
+    switch (state_) {
+      case kSTRING:  p = ContinueString(p, end);  break;
+      case kNUMBER:  p = ContinueNumber(p, end);  break;
+      case kLITERAL: p = ContinueLiteral(p, end); break;
+      default:       p = SkipWhitespace(p, end);
+                     if (p < end) p = Step(p);
+    }
+  }
+  return status_;
+}
+
+template <typename Handler>
+JsonStatus PushParser<Handler>::Finish() {
+  static const char kEnd = '\0';
+  if (!status_.Ok()) return status_;
+  tok_ = &kEnd;
+  switch (state_) {
+    case kSTRING:  EndString(&kEnd); // reports why it is unterminated
+                   break;
+    case kNUMBER:  EndNumber(&kEnd);
+                   break;
+    case kLITERAL: Fail(JsonStatus::kJSON_PARSE_INVALID_VALUE);
+                   break;
+    default:       break;
+  }
+  /* The end acts like the '\0' Value::Parse finds past the input. */
+  while (status_.Ok() && !(state_ == kAFTER_VALUE && depth_ == 0)) Step(&kEnd);
+  return status_;
+}
+
+template <typename Handler>
+const char* PushParser<Handler>::Step(const char* p) {
+  char c = *p;
+  switch (state_) {
+    case kVALUE:
+      return StartValue(p);
+    case kARRAY_FIRST:
+      if (c == ']') {
+        EndContainer(false);
+        return p + 1;
+      }
+      state_ = kVALUE;
+      return p;
+    case kOBJECT_FIRST:
+      if (c == '}') {
+        EndContainer(true);
+        return p + 1;
+      }
+      state_ = kKEY;
+      return p;
+    case kKEY:
+      if (c != '\"') {
+        Fail(JsonStatus::kJSON_PARSE_OBJECT_MISSING_KEY);
+        return p;
+      }
+      state_ = kSTRING;
+      key_ = true;
+      tok_ = p;
+      return p;
+    case kCOLON:
+      if (c != ':') {
+        Fail(JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON);
+        return p;
+      }
+      state_ = kVALUE;
+      return p + 1;
+    case kAFTER_VALUE:
+      if (depth_ == 0) {
+        Fail(JsonStatus::kJSON_PARSE_ROOT_NOT_SINGULAR);
+      } else if (c == (in_object_ ? '}' : ']')) {
+        EndContainer(in_object_);
+        return p + 1;
+      } else if (c == ',') {
+        state_ = in_object_ ? kOBJECT_NEXT : kARRAY_NEXT;
+        return p + 1;
+      } else {
+        Fail(in_object_ ? JsonStatus::kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET
+                        : JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA);
+      }
+      return p;
+    case kARRAY_NEXT:
+      if (c == ']') {
+        Fail(JsonStatus::kJSON_PARSE_ARRAY_INVALID_EXTRA_COMMA);
+        return p;
+      }
+      state_ = kVALUE;
+      return p;
+    case kOBJECT_NEXT:
+      if (c == '}') {
+        Fail(JsonStatus::kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA);
+        return p;
+      }
+      state_ = kKEY;
+      return p;
+    default:
+      assert(false); // tokens are handled by the Continue* functions
+      return p;
+  }
+}
+
+template <typename Handler>
+const char* PushParser<Handler>::StartValue(const char* p) {
+  switch (*p) {
+    case 'n':  lit_ = "null";  break;
+    case 't':  lit_ = "true";  break;
+    case 'f':  lit_ = "false"; break;
+    case '[':  // fall through
+    case '{':  if (depth_ == JSONUTIL_PARSE_MAX_DEPTH) {
+                 Fail(JsonStatus::kJSON_PARSE_MAX_DEPTH_EXCEEDED);
+                 return p;
+               }
+               if (!(*p == '[' ? h_.StartArray() : h_.StartObject())) {
+                 Fail(JsonStatus::kJSON_PARSE_HANDLER_ABORTED);
+                 return p;
+               }
+               if (depth_ > 0) {
+                 int saved = (count_ << 1) | (in_object_ ? 1 : 0);
+                 memcpy(nest_.Push(sizeof(saved)), &saved, sizeof(saved));
+               }
+               ++depth_;
+               count_ = 0;
+               in_object_ = (*p == '{');
+               state_ = in_object_ ? kOBJECT_FIRST : kARRAY_FIRST;
+               return p + 1;
+    case '\"': state_ = kSTRING;
+               key_ = false;
+               tok_ = p;
+               return p;
+    case '\0': Fail(JsonStatus::kJSON_PARSE_EXPECT_VALUE);
+               return p;
+    default:   state_ = kNUMBER;
+               tok_ = p;
+               return p;
+  }
+  state_ = kLITERAL;
+  lit_pos_ = 0;
+  return p;
+}
+
+template <typename Handler>
+const char* PushParser<Handler>::ContinueString(const char* p, const char* end) {
+  if (p == tok_ && token_.Top() == 0) ++p; // the opening mark
+  while (true) {
+    if (escape_) {
+      if (p == end) break;
+      ++p; // the escaped byte can't end the string
+      escape_ = false;
+    }
+    p = ScanStringRun(p, end);
+    if (p == end) break;
+    if (*p == '\\') {
+      escape_ = true;
+      ++p;
+      continue;
+    }
+    /* The closing mark, or a control byte the decoder will reject. */
+    EndString(p + 1);
+    return p + 1;
+  }
+  token_.PushString(tok_, static_cast<int>(end - tok_));
+  return end;
+}
+
+template <typename Handler>
+const char* PushParser<Handler>::ContinueNumber(const char* p, const char* end) {
+  while (p < end && IsNumberChar(*p)) ++p;
+  if (p < end) {
+    EndNumber(p);
+    return p;
+  }
+  token_.PushString(tok_, static_cast<int>(end - tok_));
+  return end;
+}
+
+template <typename Handler>
+const char* PushParser<Handler>::ContinueLiteral(const char* p, const char* end) {
+  for (; p < end && lit_[lit_pos_]; ++p, ++lit_pos_) {
+    if (*p != lit_[lit_pos_]) {
+      Fail(JsonStatus::kJSON_PARSE_INVALID_VALUE);
+      return p;
+    }
+  }
+  if (lit_[lit_pos_] == '\0') {
+    EndValue(lit_[0] == 'n' ? h_.Null() : h_.Bool(lit_[0] == 't'));
+  }
+  return p;
+}
+
+/* The whole token up to @end: straight from the chunk unless earlier chunks
+ * left part of it in token_. */
+template <typename Handler>
+Slice PushParser<Handler>::TokenUntil(const char* end) {
+  int len = static_cast<int>(end - tok_);
+  if (token_.Top() == 0) return Slice(tok_, len);
+  token_.PushString(tok_, len);
+  len = token_.Top();
+  return Slice(token_.Pop(len), len); // the bytes stay put until the next push
+}
+
+template <typename Handler>
+void PushParser<Handler>::EndString(const char* end) {
+  Slice s = TokenUntil(end);
+  const char* str = s.Ptr() + 1;
+  int len = ScanPlainString(s);
+  if (len < 0) {
+    JsonStatus ret = ParseStringInStack(scratch_, s, len);
+    if (!ret.Ok()) {
+      status_ = ret;
+      return;
+    }
+    str = scratch_.Pop(len);
+  }
+  if (key_) {
+    if (!h_.Key(str, len)) {
+      Fail(JsonStatus::kJSON_PARSE_HANDLER_ABORTED);
+      return;
+    }
+    state_ = kCOLON;
+    return;
+  }
+  EndValue(h_.String(str, len));
+}
+
+template <typename Handler>
+void PushParser<Handler>::EndNumber(const char* end) {
+  Slice s = TokenUntil(end);
+  jsonutil::Number num;
+  JsonStatus ret = ScanNumber(s, num);
+  if (!ret.Ok()) {
+    status_ = ret;
+    return;
+  }
+  switch (num.kind) {
+    case jsonutil::Number::kINT64:  EndValue(h_.Int64(num.val.i64));  break;
+    case jsonutil::Number::kUINT64: EndValue(h_.Uint64(num.val.u64)); break;
+    default:                        EndValue(h_.Number(num.val.d));
+  }
+  /* Bytes like the second '.' of "1.2.3" are left over: Value::Parse sees
+   * them where a ',' or the end should be. */
+  if (status_.Ok() && s.Len() > 0) Step(s.Ptr());
+}
+
+template <typename Handler>
+void PushParser<Handler>::EndValue(bool ok) {
+  if (!ok) {
+    Fail(JsonStatus::kJSON_PARSE_HANDLER_ABORTED);
+    return;
+  }
+  ++count_;
+  state_ = kAFTER_VALUE;
+}
+
+template <typename Handler>
+void PushParser<Handler>::EndContainer(bool object) {
+  int size = count_;
+  if (--depth_ > 0) {
+    int saved = 0;
+    memcpy(&saved, nest_.Pop(sizeof(saved)), sizeof(saved));
+    count_ = saved >> 1;
+    in_object_ = (saved & 1) != 0;
+  }
+  EndValue(object ? h_.EndObject(size) : h_.EndArray(size));
+}
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_PUSH_PARSER_H__
@@ -0,0 +1,245 @@
+#ifndef JSONUTIL_SRC_READER_H__
+#define JSONUTIL_SRC_READER_H__
+
+#include "stack.h"
+#include "slice.h"
+#include "simd.h"
+#include "number.h"
+#include "decode.h"
+#include "json_status.h"
+
+#include <stdint.h>
+
+namespace jsonutil {
+/* Event (SAX) parser: reports the document to a handler instead of building
+ * a tree. A handler is any class with the members below; each returns false
+ * to stop the parse with kJSON_PARSE_HANDLER_ABORTED.
+ *
+ *   bool Null();
+ *   bool Bool(bool b);
+ *   bool Int64(int64_t i);      integral literals, see kJSON_INT64
+ *   bool Uint64(uint64_t u);    integral literals above INT64_MAX
+ *   bool Number(double d);
+ *   bool String(const char* s, int len);
+ *   bool StartObject();
+ *   bool Key(const char* s, int len);
+ *   bool EndObject(int size);   @size is the number of members
+ *   bool StartArray();
+ *   bool EndArray(int size);    @size is the number of elements
+ *
+ * String and key bytes are only valid during the call and are not
+ * '\0'-terminated: escape-free ones point into the input, others are decoded
+ * into a scratch stack the Reader keeps across parses. Syntax errors give the
+ * same JsonStatus as Value::Parse, after the events that preceded them. */
+class Reader {
+ public:
+  Reader() {
+  }
+
+  template <typename Handler>
+  JsonStatus Parse(const char* text, int len, Handler& h);
+
+ private:
+  /* Reader is noncopyable. */
+  Reader(const Reader&);
+  const Reader& operator=(const Reader&);
+
+  static char Peek(const Slice& s) { return s.Len() ? *s.Ptr() : '\0'; }
+  static void SkipSpace(Slice& s) {
+    const char* p = SkipWhitespace(s.Ptr(), s.Ptr() + s.Len());
+    s.Move(static_cast<int>(p - s.Ptr()));
+  }
+
+  /* @depth is the number of containers around the value. */
+  template <typename Handler>
+  JsonStatus ParseValue(Slice& s, Handler& h, int depth);
+  template <typename Handler>
+  JsonStatus ParseLiteral(Slice& s, Handler& h);
+  template <typename Handler>
+  JsonStatus ParseNumber(Slice& s, Handler& h);
+  template <typename Handler>
+  JsonStatus ParseString(Slice& s, Handler& h, bool key);
+  template <typename Handler>
+  JsonStatus ParseArray(Slice& s, Handler& h, int depth);
+  template <typename Handler>
+  JsonStatus ParseObject(Slice& s, Handler& h, int depth);
+
+  Stack stk_;
+};
+
+/* Accepts every event. Derive from it (BaseHandler<MyHandler>) and hide only
+ * the callbacks you care about; Int64 and Uint64 fall back to Number. */
+template <typename Derived>
+struct BaseHandler {
+  bool Null() { return true; }
+  bool Bool(bool b) { return true; }
+  bool Int64(int64_t i) {
+    return static_cast<Derived*>(this)->Number(static_cast<double>(i));
+  }
+  bool Uint64(uint64_t u) {
+    return static_cast<Derived*>(this)->Number(static_cast<double>(u));
+  }
+  bool Number(double d) { return true; }
+  bool String(const char* s, int len) { return true; }
+  bool StartObject() { return true; }
+  bool Key(const char* s, int len) { return true; }
+  bool EndObject(int size) { return true; }
+  bool StartArray() { return true; }
+  bool EndArray(int size) { return true; }
+};
+
+template <typename Handler>
+JsonStatus Reader::Parse(const char* text, int len, Handler& h) {
+  assert(text != NULL);
+  stk_.Pop(stk_.Top()); // drop leftovers of a failed parse
+  Slice s(text, len);
+  SkipSpace(s);
+  JsonStatus ret = ParseValue(s, h, 0);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  SkipSpace(s);
+  if (s.Len() != 0) return JsonStatus::kJSON_PARSE_ROOT_NOT_SINGULAR;
+  return ret;
+}
+
+template <typename Handler>
+JsonStatus Reader::ParseValue(Slice& s, Handler& h, int depth) {
+  switch (Peek(s)) {
+    case 'n':  // fall through
+    case 'f':  // fall through
+    case 't':  return ParseLiteral(s, h);
+    case '[':  return ParseArray(s, h, depth);
+    case '{':  return ParseObject(s, h, depth);
+    case '\"': return ParseString(s, h, false);
+    case '\0': return JsonStatus::kJSON_PARSE_EXPECT_VALUE;
+    default:   return ParseNumber(s, h);
+  }
+}
+
+template <typename Handler>
+JsonStatus Reader::ParseLiteral(Slice& s, Handler& h) {
+  const char* p = s.Ptr();
+  bool ok = false;
+  if (p[0] == 'n' && s.Len() >= 4 && p[1] == 'u' && p[2] == 'l' && p[3] == 'l') {
+    s.Move(4);
+    ok = h.Null();
+  } else if (p[0] == 't' && s.Len() >= 4
+             && p[1] == 'r' && p[2] == 'u' && p[3] == 'e') {
+    s.Move(4);
+    ok = h.Bool(true);
+  } else if (p[0] == 'f' && s.Len() >= 5
+             && p[1] == 'a' && p[2] == 'l' && p[3] == 's' && p[4] == 'e') {
+    s.Move(5);
+    ok = h.Bool(false);
+  } else {
+    return JsonStatus::kJSON_PARSE_INVALID_VALUE;
+  }
+  return ok ? JsonStatus::kJSON_OK : JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+}
+
+template <typename Handler>
+JsonStatus Reader::ParseNumber(Slice& s, Handler& h) {
+  jsonutil::Number num;
+  JsonStatus ret = ScanNumber(s, num);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  bool ok = false;
+  switch (num.kind) {
+    case jsonutil::Number::kINT64:  ok = h.Int64(num.val.i64);  break;
+    case jsonutil::Number::kUINT64: ok = h.Uint64(num.val.u64); break;
+    default:                        ok = h.Number(num.val.d);
+  }
+  return ok ? JsonStatus::kJSON_OK : JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+}
+
+template <typename Handler>
+JsonStatus Reader::ParseString(Slice& s, Handler& h, bool key) {
+  const char* str = s.Ptr() + 1;
+  int len = ScanPlainString(s);
+  if (len >= 0) {
+    s.Move(len + 2);
+  } else {
+    JsonStatus ret = ParseStringInStack(stk_, s, len);
+    if (ret != JsonStatus::kJSON_OK) return ret;
+    str = stk_.Pop(len); // the bytes stay put until the next push
+  }
+  bool ok = key ? h.Key(str, len) : h.String(str, len);
+  return ok ? JsonStatus::kJSON_OK : JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+}
+
+template <typename Handler>
+JsonStatus Reader::ParseArray(Slice& s, Handler& h, int depth) {
+  if (depth == JSONUTIL_PARSE_MAX_DEPTH) {
+    return JsonStatus::kJSON_PARSE_MAX_DEPTH_EXCEEDED;
+  }
+  s.Move(1);
+  if (!h.StartArray()) return JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+  SkipSpace(s);
+  int num = 0;
+  if (Peek(s) == ']') {
+    s.Move(1);
+    return h.EndArray(num) ? JsonStatus::kJSON_OK
+                           : JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+  }
+  while (true) {
+    JsonStatus ret = ParseValue(s, h, depth + 1);
+    if (ret != JsonStatus::kJSON_OK) return ret;
+    ++num;
+    SkipSpace(s);
+    char c = Peek(s);
+    if (c == ']') {
+      s.Move(1);
+      return h.EndArray(num) ? JsonStatus::kJSON_OK
+                             : JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+    } else if (c == ',') {
+      s.Move(1);
+      SkipSpace(s);
+      if (Peek(s) == ']') return JsonStatus::kJSON_PARSE_ARRAY_INVALID_EXTRA_COMMA;
+    } else {
+      return JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA;
+    }
+  }
+}
+
+template <typename Handler>
+JsonStatus Reader::ParseObject(Slice& s, Handler& h, int depth) {
+  if (depth == JSONUTIL_PARSE_MAX_DEPTH) {
+    return JsonStatus::kJSON_PARSE_MAX_DEPTH_EXCEEDED;
+  }
+  s.Move(1);
+  if (!h.StartObject()) return JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+  SkipSpace(s);
+  int num = 0;
+  if (Peek(s) == '}') {
+    s.Move(1);
+    return h.EndObject(num) ? JsonStatus::kJSON_OK
+                            : JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+  }
+  while (true) {
+    SkipSpace(s);
+    if (Peek(s) != '\"') return JsonStatus::kJSON_PARSE_OBJECT_MISSING_KEY;
+    JsonStatus ret = ParseString(s, h, true);
+    if (ret != JsonStatus::kJSON_OK) return ret;
+    SkipSpace(s);
+    if (Peek(s) != ':') return JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON;
+    s.Move(1);
+    SkipSpace(s);
+    ret = ParseValue(s, h, depth + 1);
+    if (ret != JsonStatus::kJSON_OK) return ret;
+    ++num;
+    SkipSpace(s);
+    char c = Peek(s);
+    if (c == '}') {
+      s.Move(1);
+      return h.EndObject(num) ? JsonStatus::kJSON_OK
+                              : JsonStatus::kJSON_PARSE_HANDLER_ABORTED;
+    } else if (c == ',') {
+      s.Move(1);
+      SkipSpace(s);
+      if (Peek(s) == '}') return JsonStatus::kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA;
+    } else {
+      return JsonStatus::kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET;
+    }
+  }
+}
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_READER_H__
@@ -0,0 +1,450 @@
+#include "simd.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define JSONUTIL_SIMD_X86 1
+#endif
+
+namespace jsonutil {
+namespace {
+
+inline bool IsWhitespaceByte(char c) {
+  return (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0');
+}
+
+inline bool EndsStringRun(char c) {
+  unsigned char u = static_cast<unsigned char>(c);
+  return (u == '\"' || u == '\\' || u < 0x20);
+}
+
+const char* SkipWhitespaceScalar(const char* p, const char* end) {
+  while (p < end && IsWhitespaceByte(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+const char* ScanStringRunScalar(const char* p, const char* end) {
+  while (p < end && !EndsStringRun(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+/* Length of the well-formed sequence that starts with the non-ASCII byte
+ * at @p, or 0 if there is none. */
+int Utf8SequenceLength(const unsigned char* p, const unsigned char* end) {
+  unsigned char lo = 0x80, hi = 0xBF; /* bounds of the second byte */
+  int n;
+  if (*p >= 0xC2 && *p <= 0xDF) {
+    n = 2;
+  } else if (*p >= 0xE0 && *p <= 0xEF) {
+    n = 3;
+    if (*p == 0xE0) lo = 0xA0; /* overlong */
+    if (*p == 0xED) hi = 0x9F; /* surrogates */
+  } else if (*p >= 0xF0 && *p <= 0xF4) {
+    n = 4;
+    if (*p == 0xF0) lo = 0x90; /* overlong */
+    if (*p == 0xF4) hi = 0x8F; /* above U+10FFFF */
+  } else {
+    return 0;
+  }
+  if (end - p < n || p[1] < lo || p[1] > hi) return 0;
+  for (int i = 2; i < n; ++i) {
+    if ((p[i] & 0xC0) != 0x80) return 0;
+  }
+  return n;
+}
+
+bool IsValidUtf8Scalar(const char* p, const char* end) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  const unsigned char* e = reinterpret_cast<const unsigned char*>(end);
+  while (u < e) {
+    if (*u < 0x80) {
+      ++u;
+      continue;
+    }
+    int n = Utf8SequenceLength(u, e);
+    if (n == 0) return false;
+    u += n;
+  }
+  return true;
+}
+
+#if defined(JSONUTIL_SIMD_X86) && defined(__SSE2__)
+#define JSONUTIL_SIMD_SSE2 1
+/* Skips ASCII 16 bytes at a time; the rest is checked a sequence at a time. */
+bool IsValidUtf8Sse2(const char* p, const char* end) {
+  const unsigned char* e = reinterpret_cast<const unsigned char*>(end);
+  while (end - p >= 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(x));
+    if (mask == 0) {
+      p += 16;
+      continue;
+    }
+    p += __builtin_ctz(mask);
+    int n = Utf8SequenceLength(reinterpret_cast<const unsigned char*>(p), e);
+    if (n == 0) return false;
+    p += n;
+  }
+  return IsValidUtf8Scalar(p, end);
+}
+
+const char* SkipWhitespaceSse2(const char* p, const char* end) {
+  const __m128i sp = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i nul = _mm_setzero_si128();
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i ws = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(x, sp), _mm_cmpeq_epi8(x, tab)),
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, cr), _mm_cmpeq_epi8(x, lf)),
+                   _mm_cmpeq_epi8(x, nul)));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(ws)) ^ 0xFFFFu;
+    if (mask) return p + __builtin_ctz(mask);
+  }
+  return SkipWhitespaceScalar(p, end);
+}
+
+const char* ScanStringRunSse2(const char* p, const char* end) {
+  const __m128i quote = _mm_set1_epi8('\"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i ctrl = _mm_set1_epi8(0x1F);
+  for (; end - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    /* max(x, 0x1F) == 0x1F <=> x <= 0x1F as unsigned */
+    __m128i stop = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, bslash)),
+      _mm_cmpeq_epi8(_mm_max_epu8(x, ctrl), ctrl));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(stop));
+    if (mask) return p + __builtin_ctz(mask);
+  }
+  return ScanStringRunScalar(p, end);
+}
+
+/* '[' | 0x20 == '{' and ']' | 0x20 == '}', so four compares find all six
+ * structural characters. */
+void ClassifyBlockSse2(const char* p, BlockMasks& m) {
+  const __m128i quote = _mm_set1_epi8('\"');
+  const __m128i bslash = _mm_set1_epi8('\\');
+  const __m128i lower = _mm_set1_epi8(0x20);
+  const __m128i lcurly = _mm_set1_epi8('{');
+  const __m128i rcurly = _mm_set1_epi8('}');
+  const __m128i colon = _mm_set1_epi8(':');
+  const __m128i comma = _mm_set1_epi8(',');
+  const __m128i sp = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i nul = _mm_setzero_si128();
+  m.quote = m.backslash = m.structural = m.space = 0;
+  for (int i = 0; i < 64; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    __m128i xl = _mm_or_si128(x, lower);
+    __m128i st = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(xl, lcurly), _mm_cmpeq_epi8(xl, rcurly)),
+      _mm_or_si128(_mm_cmpeq_epi8(x, colon), _mm_cmpeq_epi8(x, comma)));
+    __m128i ws = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(x, sp), _mm_cmpeq_epi8(x, tab)),
+      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, cr), _mm_cmpeq_epi8(x, lf)),
+                   _mm_cmpeq_epi8(x, nul)));
+    m.quote |= static_cast<uint64_t>(
+      static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, quote)))) << i;
+    m.backslash |= static_cast<uint64_t>(
+      static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, bslash)))) << i;
+    m.structural |= static_cast<uint64_t>(
+      static_cast<uint32_t>(_mm_movemask_epi8(st))) << i;
+    m.space |= static_cast<uint64_t>(
+      static_cast<uint32_t>(_mm_movemask_epi8(ws))) << i;
+  }
+}
+#endif
+
+#ifdef JSONUTIL_SIMD_X86
+__attribute__((target("avx2")))
+const char* SkipWhitespaceAvx2(const char* p, const char* end) {
+  const __m256i sp = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const __m256i nul = _mm256_setzero_si256();
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i ws = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, sp), _mm256_cmpeq_epi8(x, tab)),
+      _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, cr), _mm256_cmpeq_epi8(x, lf)),
+        _mm256_cmpeq_epi8(x, nul)));
+    uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(ws));
+    if (mask) return p + __builtin_ctz(mask);
+  }
+  return SkipWhitespaceScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* ScanStringRunAvx2(const char* p, const char* end) {
+  const __m256i quote = _mm256_set1_epi8('\"');
+  const __m256i bslash = _mm256_set1_epi8('\\');
+  const __m256i ctrl = _mm256_set1_epi8(0x1F);
+  for (; end - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i stop = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, quote), _mm256_cmpeq_epi8(x, bslash)),
+      _mm256_cmpeq_epi8(_mm256_max_epu8(x, ctrl), ctrl));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(stop));
+    if (mask) return p + __builtin_ctz(mask);
+  }
+  return ScanStringRunScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+void ClassifyBlockAvx2(const char* p, BlockMasks& m) {
+  const __m256i quote = _mm256_set1_epi8('\"');
+  const __m256i bslash = _mm256_set1_epi8('\\');
+  const __m256i lower = _mm256_set1_epi8(0x20);
+  const __m256i lcurly = _mm256_set1_epi8('{');
+  const __m256i rcurly = _mm256_set1_epi8('}');
+  const __m256i colon = _mm256_set1_epi8(':');
+  const __m256i comma = _mm256_set1_epi8(',');
+  const __m256i sp = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const __m256i nul = _mm256_setzero_si256();
+  m.quote = m.backslash = m.structural = m.space = 0;
+  for (int i = 0; i < 64; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    __m256i xl = _mm256_or_si256(x, lower);
+    __m256i st = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(xl, lcurly), _mm256_cmpeq_epi8(xl, rcurly)),
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, colon), _mm256_cmpeq_epi8(x, comma)));
+    __m256i ws = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(x, sp), _mm256_cmpeq_epi8(x, tab)),
+      _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(x, cr), _mm256_cmpeq_epi8(x, lf)),
+        _mm256_cmpeq_epi8(x, nul)));
+    m.quote |= static_cast<uint64_t>(
+      static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, quote)))) << i;
+    m.backslash |= static_cast<uint64_t>(
+      static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, bslash)))) << i;
+    m.structural |= static_cast<uint64_t>(
+      static_cast<uint32_t>(_mm256_movemask_epi8(st))) << i;
+    m.space |= static_cast<uint64_t>(
+      static_cast<uint32_t>(_mm256_movemask_epi8(ws))) << i;
+  }
+}
+
+/* UTF-8 validation by lookup (Keiser and Lemire, "Validating UTF-8 in less
+ * than one instruction per byte", 2021). Each byte is checked together with
+ * the one before it: three 16-entry tables indexed by the high and low
+ * nibble of the previous byte and the high nibble of this one each give a
+ * set of error bits, and an error is any bit left in all three. Only the
+ * third and fourth bytes of long sequences need the bytes two and three
+ * back, which is whether they are continuations. */
+enum {
+  kTOO_SHORT = 1 << 0,   /* lead byte not followed by a continuation */
+  kTOO_LONG = 1 << 1,    /* continuation after ASCII */
+  kOVERLONG_3 = 1 << 2,
+  kTOO_LARGE = 1 << 3,   /* above U+10FFFF */
+  kSURROGATE = 1 << 4,
+  kOVERLONG_2 = 1 << 5,
+  kTOO_LARGE_1000 = 1 << 6,
+  kOVERLONG_4 = 1 << 6,
+  kTWO_CONTS = 1 << 7,   /* continuation after continuation */
+  kCARRY = kTOO_SHORT | kTOO_LONG | kTWO_CONTS
+};
+
+/* Indexed by the high nibble of the previous byte. */
+const uint8_t kUtf8PrevHigh[16] = {
+  kTOO_LONG, kTOO_LONG, kTOO_LONG, kTOO_LONG,
+  kTOO_LONG, kTOO_LONG, kTOO_LONG, kTOO_LONG,
+  kTWO_CONTS, kTWO_CONTS, kTWO_CONTS, kTWO_CONTS,
+  kTOO_SHORT | kOVERLONG_2,
+  kTOO_SHORT,
+  kTOO_SHORT | kOVERLONG_3 | kSURROGATE,
+  kTOO_SHORT | kTOO_LARGE | kTOO_LARGE_1000 | kOVERLONG_4
+};
+
+/* Indexed by the low nibble of the previous byte. */
+const uint8_t kUtf8PrevLow[16] = {
+  kCARRY | kOVERLONG_3 | kOVERLONG_2 | kOVERLONG_4,
+  kCARRY | kOVERLONG_2,
+  kCARRY,
+  kCARRY,
+  kCARRY | kTOO_LARGE,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000 | kSURROGATE,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000,
+  kCARRY | kTOO_LARGE | kTOO_LARGE_1000
+};
+
+/* Indexed by the high nibble of the byte itself. */
+const uint8_t kUtf8High[16] = {
+  kTOO_SHORT, kTOO_SHORT, kTOO_SHORT, kTOO_SHORT,
+  kTOO_SHORT, kTOO_SHORT, kTOO_SHORT, kTOO_SHORT,
+  kTOO_LONG | kOVERLONG_2 | kTWO_CONTS | kOVERLONG_3 | kTOO_LARGE_1000 | kOVERLONG_4,
+  kTOO_LONG | kOVERLONG_2 | kTWO_CONTS | kOVERLONG_3 | kTOO_LARGE,
+  kTOO_LONG | kOVERLONG_2 | kTWO_CONTS | kSURROGATE | kTOO_LARGE,
+  kTOO_LONG | kOVERLONG_2 | kTWO_CONTS | kSURROGATE | kTOO_LARGE,
+  kTOO_SHORT, kTOO_SHORT, kTOO_SHORT, kTOO_SHORT
+};
+
+/* A block ending in one of these needs the next block to finish it. */
+const uint8_t kUtf8IncompleteMax[32] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1
+};
+
+__attribute__((target("avx2")))
+inline __m256i LoadTable(const uint8_t* t) {
+  return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(t)));
+}
+
+/* Error bits of block @x, whose previous block is @prev. */
+__attribute__((target("avx2")))
+inline __m256i Utf8BlockErrors(__m256i x, __m256i prev) {
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  __m256i across = _mm256_permute2x128_si256(prev, x, 0x21);
+  __m256i prev1 = _mm256_alignr_epi8(x, across, 15);
+  __m256i prev2 = _mm256_alignr_epi8(x, across, 14);
+  __m256i prev3 = _mm256_alignr_epi8(x, across, 13);
+  __m256i e = _mm256_and_si256(
+    _mm256_and_si256(
+      _mm256_shuffle_epi8(LoadTable(kUtf8PrevHigh),
+                          _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+      _mm256_shuffle_epi8(LoadTable(kUtf8PrevLow), _mm256_and_si256(prev1, nibble))),
+    _mm256_shuffle_epi8(LoadTable(kUtf8High),
+                        _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble)));
+  /* Bit 7 set where a 3- or 4-byte lead sits two or three bytes back. */
+  __m256i must23 = _mm256_and_si256(
+    _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80)),
+                    _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80))),
+    _mm256_set1_epi8(static_cast<char>(0x80)));
+  /* Those bytes show up as kTWO_CONTS above, which is an error elsewhere. */
+  return _mm256_xor_si256(must23, e);
+}
+
+__attribute__((target("avx2")))
+bool IsValidUtf8Avx2(const char* p, const char* end) {
+  const __m256i max = _mm256_loadu_si256(
+    reinterpret_cast<const __m256i*>(kUtf8IncompleteMax));
+  __m256i prev = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  __m256i error = _mm256_setzero_si256();
+  char tail[32];
+  while (p < end) {
+    __m256i x;
+    if (end - p >= 32) {
+      x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+      p += 32;
+    } else {
+      /* Padding with NULs (ASCII) flags a sequence cut off by @end. */
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, p, end - p);
+      x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tail));
+      p = end;
+    }
+    if (_mm256_movemask_epi8(x) == 0) {
+      error = _mm256_or_si256(error, incomplete);
+      incomplete = _mm256_setzero_si256();
+    } else {
+      error = _mm256_or_si256(error, Utf8BlockErrors(x, prev));
+      incomplete = _mm256_subs_epu8(x, max);
+    }
+    prev = x;
+  }
+  error = _mm256_or_si256(error, incomplete);
+  return _mm256_testz_si256(error, error) != 0;
+}
+#endif
+
+#ifndef JSONUTIL_SIMD_SSE2
+void ClassifyBlockScalar(const char* p, BlockMasks& m) {
+  m.quote = m.backslash = m.structural = m.space = 0;
+  for (int i = 0; i < 64; ++i) {
+    uint64_t bit = 1ULL << i;
+    char c = p[i];
+    if (c == '\"') m.quote |= bit;
+    if (c == '\\') m.backslash |= bit;
+    if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') {
+      m.structural |= bit;
+    }
+    if (IsWhitespaceByte(c)) m.space |= bit;
+  }
+}
+#endif
+
+struct Kernels {
+  const char* (*skip_whitespace)(const char*, const char*);
+  const char* (*scan_string_run)(const char*, const char*);
+  void (*classify_block)(const char*, BlockMasks&);
+  bool (*is_valid_utf8)(const char*, const char*);
+  const char* name;
+};
+
+Kernels PickKernels() {
+#ifdef JSONUTIL_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    Kernels k = { SkipWhitespaceAvx2, ScanStringRunAvx2, ClassifyBlockAvx2,
+                  IsValidUtf8Avx2, "avx2" };
+    return k;
+  }
+#endif
+#ifdef JSONUTIL_SIMD_SSE2
+  Kernels k = { SkipWhitespaceSse2, ScanStringRunSse2, ClassifyBlockSse2,
+                IsValidUtf8Sse2, "sse2" };
+  return k;
+#else
+  Kernels k = { SkipWhitespaceScalar, ScanStringRunScalar, ClassifyBlockScalar,
+                IsValidUtf8Scalar, "scalar" };
+  return k;
+#endif
+}
+
+inline const Kernels& GetKernels() {
+  static const Kernels kernels = PickKernels();
+  return kernels;
+}
+
+} // static-function namespace
+
+const char* SkipWhitespace(const char* p, const char* end) {
+  /* Most runs are empty or a single separator; don't pay for a vector. */
+  if (p == end || !IsWhitespaceByte(*p)) return p;
+  ++p;
+  if (p == end || !IsWhitespaceByte(*p)) return p;
+  return GetKernels().skip_whitespace(p, end);
+}
+
+const char* ScanStringRun(const char* p, const char* end) {
+  return GetKernels().scan_string_run(p, end);
+}
+
+void ClassifyBlock(const char* p, BlockMasks& m) {
+  GetKernels().classify_block(p, m);
+}
+
+bool IsValidUtf8(const char* p, const char* end) {
+  return GetKernels().is_valid_utf8(p, end);
+}
+
+const char* SimdKernelName() {
+  return GetKernels().name;
+}
+} // namespace jsonutil
@@ -0,0 +1,38 @@
+#ifndef JSONUTIL_SRC_SIMD_H__
+#define JSONUTIL_SRC_SIMD_H__
+
+#include <stdint.h>
+
+namespace jsonutil {
+/* Byte-scanning kernels for the parser's hot loops. The implementation
+ * (AVX2, SSE2 or scalar) is picked once at runtime from the CPU features. */
+
+/* Returns the first byte in [p, end) that is not whitespace, or end.
+ * Whitespace here is what the parser skips: ' ', '\t', '\r', '\n' and '\0'. */
+const char* SkipWhitespace(const char* p, const char* end);
+
+/* Returns the first byte in [p, end) that ends a run of plain string bytes,
+ * i.e. '"', '\\' or a control character below 0x20, or end. */
+const char* ScanStringRun(const char* p, const char* end);
+
+/* Whether [p, end) is well-formed UTF-8: no stray continuation bytes,
+ * truncated or overlong sequences, surrogates or code points above
+ * U+10FFFF. */
+bool IsValidUtf8(const char* p, const char* end);
+
+/* Bit i of each mask describes byte i of a 64-byte block. */
+struct BlockMasks {
+  uint64_t quote;      /* '"' */
+  uint64_t backslash;  /* '\\' */
+  uint64_t structural; /* '{', '}', '[', ']', ':' and ',' */
+  uint64_t space;      /* whitespace, as for SkipWhitespace */
+};
+
+/* Classifies the 64 bytes at @p, which must all be readable. */
+void ClassifyBlock(const char* p, BlockMasks& m);
+
+/* Name of the kernels in use: "avx2", "sse2" or "scalar". */
+const char* SimdKernelName();
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_SIMD_H__
@@ -3,6 +3,7 @@
 namespace jsonutil {
 int Compare(const char* lhs, int llen, const char* rhs, int rlen) {
   assert(lhs && rhs);
+  if (lhs == rhs) return llen == rlen ? 0 : (llen < rlen ? -1 : 1); // e.g. pooled keys
   int min_len = llen < rlen ? llen : rlen;
   for (int i = 0; i < min_len; ++i) {
     if (lhs[i] != rhs[i]) {
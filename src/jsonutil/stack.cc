@@ -23,7 +23,6 @@ char* Stack::Push(int size) {
       size_ += size_ >> 1;
     }
     stk_ = static_cast<char*>(realloc(stk_, size_));
-    memset(stk_ + top_, 0, size_ - top_);
   }
   char* ret = stk_ + top_;
   top_ += size;
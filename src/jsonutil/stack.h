@@ -18,6 +18,7 @@ class Stack {
     Free();
   }
   char* Pop(int size);
+  /* The @size bytes returned are uninitialized. */
   char* Push(int size);
   char* Dump() { return Pop(top_); }
   void Prepare(int size);
@@ -0,0 +1,81 @@
+#include "string_pool.h"
+#include "json.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace jsonutil {
+
+StringPool::StringPool(int value_len, int max_strings)
+  : value_len_(value_len), max_strings_(max_strings) {
+  assert(value_len >= 0 && max_strings >= 0);
+}
+
+StringPool::~StringPool() {
+  for (int i = 0; i < JSONUTIL_STRING_POOL_SHARDS; ++i) {
+    free(shards_[i].table);
+  }
+}
+
+/* Double the table of @sh, or create it. */
+bool StringPool::Grow(Shard& sh) {
+  uint32_t slots = sh.table ? 2 * (sh.mask + 1) : 64;
+  Entry* table = static_cast<Entry*>(calloc(slots, sizeof(Entry)));
+  if (table == NULL) return false;
+  uint32_t mask = slots - 1;
+  for (uint32_t i = 0; sh.table && i <= sh.mask; ++i) {
+    const Entry& e = sh.table[i];
+    if (e.s == NULL) continue;
+    uint32_t h = e.hash & mask;
+    while (table[h].s) h = (h + 1) & mask;
+    table[h] = e;
+  }
+  free(sh.table);
+  sh.table = table;
+  sh.mask = mask;
+  return true;
+}
+
+const char* StringPool::Intern(const char* s, int len) {
+  return Intern(Key(s, len));
+}
+
+const char* StringPool::Intern(const Key& key) {
+  const char* s = key.Ptr();
+  int len = key.Len();
+  uint32_t hash = key.Hash();
+  /* The low bits pick the slot inside a shard, the high ones the shard. */
+  Shard& sh = shards_[(hash >> 24) % JSONUTIL_STRING_POOL_SHARDS];
+  std::lock_guard<std::mutex> lock(sh.mu);
+  uint32_t h = hash & sh.mask;
+  for (; sh.table && sh.table[h].s; h = (h + 1) & sh.mask) {
+    const Entry& e = sh.table[h];
+    if (e.hash == hash && e.len == len && memcmp(e.s, s, len) == 0) return e.s;
+  }
+  if (sh.num * JSONUTIL_STRING_POOL_SHARDS >= max_strings_) return NULL;
+  if (sh.table == NULL || 2 * (sh.num + 1) > static_cast<int>(sh.mask + 1)) {
+    if (!Grow(sh)) return NULL;
+    for (h = hash & sh.mask; sh.table[h].s; h = (h + 1) & sh.mask) {}
+  }
+  char* p = static_cast<char*>(sh.bytes.Allocate(len + 1));
+  if (p == NULL) return NULL;
+  if (len > 0) memcpy(p, s, len);
+  p[len] = '\0';
+  sh.table[h].s = p;
+  sh.table[h].len = len;
+  sh.table[h].hash = hash;
+  ++sh.num;
+  return p;
+}
+
+int StringPool::Size() {
+  int num = 0;
+  for (int i = 0; i < JSONUTIL_STRING_POOL_SHARDS; ++i) {
+    std::lock_guard<std::mutex> lock(shards_[i].mu);
+    num += shards_[i].num;
+  }
+  return num;
+}
+
+} // namespace jsonutil
@@ -0,0 +1,73 @@
+#ifndef JSONUTIL_SRC_STRING_POOL_H__
+#define JSONUTIL_SRC_STRING_POOL_H__
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <mutex>
+
+#ifndef JSONUTIL_STRING_POOL_SHARDS
+  #define JSONUTIL_STRING_POOL_SHARDS 16
+#endif
+
+namespace jsonutil {
+class Key;
+
+/* A set of immutable strings, each stored once. A parse given a pool (see
+ * ParseContext) puts object keys, and string values shorter than
+ * @value_len but too long to sit inside a Value (13 bytes), in the pool
+ * instead of copying them into every tree, so that documents sharing a
+ * schema share their key bytes. Strings that sit in the pool are equal
+ * exactly when their pointers are, which Compare and key lookups check
+ * first.
+ * Interned bytes live as long as the pool: it must outlive every tree that
+ * refers to it, and such strings must not be modified in place. The pool is
+ * safe to share between threads; it is split into independently locked
+ * shards. */
+class StringPool {
+ public:
+  /* Once about @max_strings distinct strings are pooled, Intern() fails and
+   * the parser falls back to copying, so that hostile input cannot grow the
+   * pool without bound. */
+  explicit StringPool(int value_len = 0, int max_strings = 1 << 20);
+  ~StringPool();
+
+  /* The pooled, '\0'-terminated copy of @s[0, len); NULL when the pool is
+   * full or out of memory. */
+  const char* Intern(const char* s, int len);
+  /* As above, reusing the hash of @key. */
+  const char* Intern(const Key& key);
+  /* String values shorter than this are interned along with keys. */
+  int ValueLength() const { return value_len_; }
+  /* Number of distinct strings pooled. */
+  int Size();
+
+ private:
+  /* StringPool is noncopyable. */
+  StringPool(const StringPool&);
+  const StringPool& operator=(const StringPool&);
+
+  struct Entry {
+    const char* s;
+    int len;
+    uint32_t hash;
+  };
+  struct Shard {
+    Shard() : table(NULL), mask(0), num(0) {
+    }
+    std::mutex mu;
+    Entry* table; /* open addressing, NULL @s marks a free slot */
+    uint32_t mask;
+    int num;
+    Arena bytes;
+  };
+
+  bool Grow(Shard& sh);
+
+  int value_len_;
+  int max_strings_;
+  Shard shards_[JSONUTIL_STRING_POOL_SHARDS];
+};
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_STRING_POOL_H__
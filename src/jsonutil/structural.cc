@@ -0,0 +1,162 @@
+#include "structural.h"
+#include "simd.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace jsonutil {
+
+namespace {
+
+/* Carried from one block to the next. */
+struct ScanCarry {
+  uint64_t escape;  /* 1 if the previous block ended in an unescaped '\\' */
+  uint64_t instring; /* all ones if the previous block ended inside a string */
+  uint64_t scalar;  /* 1 if the previous block ended inside a scalar run */
+};
+
+/* Bytes escaped by a backslash. Backslash runs are rare and short, so a
+ * loop over their bits is enough. */
+uint64_t EscapedBytes(uint64_t backslash, ScanCarry& c) {
+  uint64_t escaped = c.escape;
+  c.escape = 0;
+  while (backslash) {
+    int i = __builtin_ctzll(backslash);
+    uint64_t bit = backslash & (0 - backslash);
+    backslash &= backslash - 1;
+    if (escaped & bit) continue;
+    if (i == 63) {
+      c.escape = 1;
+    } else {
+      escaped |= bit << 1;
+    }
+  }
+  return escaped;
+}
+
+/* Bit i is the parity of the bits 0..i of @x. */
+uint64_t PrefixXor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+/* Offsets of the token starts in the block at @p. */
+uint64_t TokenStarts(const char* p, ScanCarry& c) {
+  BlockMasks m;
+  ClassifyBlock(p, m);
+  uint64_t quote = m.quote & ~EscapedBytes(m.backslash, c);
+  /* From each opening quote up to, not including, its closing quote. */
+  uint64_t instring = PrefixXor(quote) ^ c.instring;
+  c.instring = 0 - (instring >> 63);
+  uint64_t scalar = ~(m.structural | m.space | quote | instring);
+  uint64_t starts = scalar & ~((scalar << 1) | c.scalar);
+  c.scalar = scalar >> 63;
+  return (m.structural & ~instring) | (quote & instring) | starts;
+}
+
+/* Whether @text[pos] follows an odd run of backslashes. */
+bool EscapedAt(const char* text, int pos) {
+  int i = pos;
+  while (i > 0 && text[i - 1] == '\\') --i;
+  return ((pos - i) & 1) != 0;
+}
+
+inline int Nesting(char c) {
+  if (c == '[' || c == '{') return 1;
+  if (c == ']' || c == '}') return -1;
+  return 0;
+}
+
+/* Adds the nesting of the 64 bytes at @p to @s, where @outside marks the
+ * bytes that are outside strings if the piece started outside one. */
+void CountNesting(const char* p, uint64_t structural, uint64_t outside, PieceSummary& s) {
+  while (structural) {
+    int i = __builtin_ctzll(structural);
+    uint64_t bit = structural & (0 - structural);
+    structural &= structural - 1;
+    s.depth[(outside & bit) ? 0 : 1] += Nesting(p[i]);
+  }
+}
+
+void PushOffsets(Stack& index, uint64_t bits, uint32_t base) {
+  if (bits == 0) return;
+  int num = __builtin_popcountll(bits);
+  uint32_t* out = reinterpret_cast<uint32_t*>(
+    index.Push(num * static_cast<int>(sizeof(uint32_t))));
+  while (bits) {
+    *out++ = base + static_cast<uint32_t>(__builtin_ctzll(bits));
+    bits &= bits - 1;
+  }
+}
+
+} // static-function namespace
+
+bool BuildStructuralIndex(const char* text, int len, Stack& index) {
+  assert(text != NULL && len >= 0);
+  ScanCarry c = { 0, 0, 0 };
+  int i = 0;
+  for (; i + 64 <= len; i += 64) {
+    PushOffsets(index, TokenStarts(text + i, c), static_cast<uint32_t>(i));
+  }
+  if (i < len) {
+    char tail[64];
+    memset(tail, ' ', sizeof(tail));
+    memcpy(tail, text + i, len - i);
+    PushOffsets(index, TokenStarts(tail, c), static_cast<uint32_t>(i));
+  }
+  return c.instring == 0;
+}
+
+void SummarizePiece(const char* text, int begin, int end, PieceSummary& s) {
+  assert(text != NULL && 0 <= begin && begin <= end);
+  s.quotes = 0;
+  s.depth[0] = s.depth[1] = 0;
+  ScanCarry c = { EscapedAt(text, begin) ? 1ULL : 0, 0, 0 };
+  for (int i = begin; i < end; i += 64) {
+    const char* p = text + i;
+    char tail[64];
+    if (end - i < 64) {
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, p, end - i);
+      p = tail;
+    }
+    BlockMasks m;
+    ClassifyBlock(p, m);
+    uint64_t quote = m.quote & ~EscapedBytes(m.backslash, c);
+    uint64_t instring = PrefixXor(quote) ^ c.instring;
+    c.instring = 0 - (instring >> 63);
+    s.quotes += __builtin_popcountll(quote);
+    CountNesting(p, m.structural, ~instring, s);
+  }
+}
+
+int FindTopLevelComma(const char* text, int begin, int end, bool instring, int depth) {
+  assert(text != NULL && 0 <= begin && begin <= end);
+  bool escaped = EscapedAt(text, begin);
+  for (int i = begin; i < end; ++i) {
+    char ch = text[i];
+    if (instring) {
+      if (escaped) {
+        escaped = false;
+      } else if (ch == '\\') {
+        escaped = true;
+      } else if (ch == '\"') {
+        instring = false;
+      }
+    } else if (ch == '\"') {
+      instring = true;
+    } else if (ch == ',' && depth == 0) {
+      return i;
+    } else {
+      depth += Nesting(ch);
+    }
+  }
+  return -1;
+}
+
+} // namespace jsonutil
@@ -0,0 +1,35 @@
+#ifndef JSONUTIL_SRC_STRUCTURAL_H__
+#define JSONUTIL_SRC_STRUCTURAL_H__
+
+#include "stack.h"
+
+#include <stdint.h>
+
+namespace jsonutil {
+/* Stage 1 of the two-stage parser (kPARSE_TWO_STAGE). Scans @text 64 bytes
+ * at a time and pushes onto @index, as uint32_t offsets in input order, the
+ * start of every token outside strings: the structural characters
+ * '{', '}', '[', ']', ':' and ',', the opening quote of each string, and the
+ * first byte of each other run (numbers, literals, garbage). Stage 2 then
+ * walks the offsets instead of the bytes.
+ * Returns false, with @index in an unspecified state, if a string is left
+ * open at the end of the input. */
+bool BuildStructuralIndex(const char* text, int len, Stack& index);
+
+/* What kPARSE_PARALLEL learns of the piece [begin, end) of @text without
+ * scanning what precedes it. Whether the piece starts inside a string is
+ * only known once the pieces before it are summed up, so the nesting is
+ * counted for both cases. */
+struct PieceSummary {
+  int quotes;   /* unescaped quotes: an odd count flips the string state */
+  int depth[2]; /* net nesting outside strings, if the piece starts outside
+                 * ([0]) or inside ([1]) a string */
+};
+void SummarizePiece(const char* text, int begin, int end, PieceSummary& s);
+
+/* Offset of the first ',' in [begin, end) of @text that is outside strings
+ * and at nesting @depth 0, given the state at @begin; -1 if there is none. */
+int FindTopLevelComma(const char* text, int begin, int end, bool instring, int depth);
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_STRUCTURAL_H__
@@ -0,0 +1,264 @@
+#include "tape.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace jsonutil {
+
+namespace {
+
+const uint64_t kPayloadMask = (1ULL << 56) - 1;
+const uint64_t kEndMask = 0xFFFFFFFFULL;
+const int kMaxCount = 0xFFFFFF;
+
+inline uint64_t MakeWord(char tag, uint64_t payload) {
+  return (static_cast<uint64_t>(static_cast<unsigned char>(tag)) << 56) | payload;
+}
+
+inline char Tag(uint64_t w) {
+  return static_cast<char>(w >> 56);
+}
+
+/* Base of the bytes pushed so far on @stk. */
+inline char* Bottom(Stack& stk) {
+  return stk.Pop(0) - stk.Top();
+}
+
+/* Reader handler that appends the events to a tape, see TapeDocument. */
+class TapeBuilder {
+ public:
+  TapeBuilder(Stack& tape, Stack& buf) : tape_(tape), buf_(buf) {
+  }
+
+  bool Null() { return Put(MakeWord('n', 0)); }
+  bool Bool(bool b) { return Put(MakeWord(b ? 't' : 'f', 0)); }
+  bool Int64(int64_t i) {
+    return Put(MakeWord('l', 0)) && Put(static_cast<uint64_t>(i));
+  }
+  bool Uint64(uint64_t u) { return Put(MakeWord('u', 0)) && Put(u); }
+  bool Number(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    return Put(MakeWord('d', 0)) && Put(u);
+  }
+  bool String(const char* s, int len) {
+    uint64_t off = static_cast<uint64_t>(buf_.Top());
+    uint32_t n = static_cast<uint32_t>(len);
+    memcpy(buf_.Push(sizeof(n)), &n, sizeof(n));
+    if (len > 0) buf_.PushString(s, len);
+    *buf_.Push(1) = '\0';
+    return Put(MakeWord('\"', off));
+  }
+  bool Key(const char* s, int len) { return String(s, len); }
+  bool StartObject() { return Open('{'); }
+  bool EndObject(int size) { return Close('}', size); }
+  bool StartArray() { return Open('['); }
+  bool EndArray(int size) { return Close(']', size); }
+
+ private:
+  /* TapeBuilder is noncopyable. */
+  TapeBuilder(const TapeBuilder&);
+  const TapeBuilder& operator=(const TapeBuilder&);
+
+  int Pos() const { return tape_.Top() / static_cast<int>(sizeof(uint64_t)); }
+
+  bool Put(uint64_t w) {
+    memcpy(tape_.Push(sizeof(w)), &w, sizeof(w));
+    return true;
+  }
+
+  bool Open(char tag) {
+    int pos = Pos();
+    memcpy(open_.Push(sizeof(pos)), &pos, sizeof(pos));
+    return Put(MakeWord(tag, 0));
+  }
+
+  /* Patch the opening word once its end and size are known. */
+  bool Close(char tag, int size) {
+    int start;
+    memcpy(&start, open_.Pop(sizeof(start)), sizeof(start));
+    uint64_t count = static_cast<uint64_t>(size < kMaxCount ? size : kMaxCount);
+    uint64_t end = static_cast<uint64_t>(Pos() + 1);
+    uint64_t* words = reinterpret_cast<uint64_t*>(Bottom(tape_));
+    words[start] |= (count << 32) | end;
+    return Put(MakeWord(tag, static_cast<uint64_t>(start)));
+  }
+
+  Stack& tape_;
+  Stack& buf_;
+  Stack open_; /* positions of the open containers */
+};
+
+} // static-function namespace
+
+JsonStatus TapeDocument::Parse(const char* text, int len) {
+  assert(text != NULL);
+  tape_.Pop(tape_.Top());
+  buf_.Pop(buf_.Top());
+  words_ = NULL;
+  size_ = 0;
+  strings_ = NULL;
+  TapeBuilder builder(tape_, buf_);
+  JsonStatus ret = reader_.Parse(text, len, builder);
+  if (ret != JsonStatus::kJSON_OK) {
+    tape_.Pop(tape_.Top());
+    buf_.Pop(buf_.Top());
+    return ret;
+  }
+  words_ = reinterpret_cast<const uint64_t*>(Bottom(tape_));
+  size_ = tape_.Top() / static_cast<int>(sizeof(uint64_t));
+  strings_ = Bottom(buf_);
+  return ret;
+}
+
+uint64_t TapeView::Word() const {
+  assert(Valid());
+  return doc_->words_[pos_];
+}
+
+int TapeView::End() const {
+  uint64_t w = Word();
+  switch (Tag(w)) {
+    case '[':
+    case '{': return static_cast<int>(w & kEndMask);
+    case 'l':
+    case 'u':
+    case 'd': return pos_ + 2;
+    default:  return pos_ + 1;
+  }
+}
+
+TapeView TapeView::At(int pos) const {
+  if (pos >= doc_->size_) return TapeView();
+  char tag = Tag(doc_->words_[pos]);
+  if (tag == ']' || tag == '}') return TapeView();
+  return TapeView(doc_, pos);
+}
+
+ValueType TapeView::Type() const {
+  switch (Tag(Word())) {
+    case 'n':  return kJSON_NULL;
+    case 'f':  return kJSON_FALSE;
+    case 't':  return kJSON_TRUE;
+    case 'l':  return kJSON_INT64;
+    case 'u':  return kJSON_UINT64;
+    case 'd':  return kJSON_NUMBER;
+    case '\"': return kJSON_STRING;
+    case '[':  return kJSON_ARRAY;
+    case '{':  return kJSON_OBJECT;
+    default:   assert(false);
+  }
+  return kJSON_NULL;
+}
+
+bool TapeView::IsNumber() const {
+  char tag = Tag(Word());
+  return (tag == 'l' || tag == 'u' || tag == 'd');
+}
+
+bool TapeView::GetBoolean() const {
+  char tag = Tag(Word());
+  assert(tag == 't' || tag == 'f');
+  return tag == 't';
+}
+
+double TapeView::GetNumber() const {
+  assert(IsNumber());
+  uint64_t u = doc_->words_[pos_ + 1];
+  switch (Tag(Word())) {
+    case 'l': return static_cast<double>(static_cast<int64_t>(u));
+    case 'u': return static_cast<double>(u);
+    default:  break;
+  }
+  double d;
+  memcpy(&d, &u, sizeof(d));
+  return d;
+}
+
+int64_t TapeView::GetInt64() const {
+  assert(Tag(Word()) == 'l');
+  return static_cast<int64_t>(doc_->words_[pos_ + 1]);
+}
+
+uint64_t TapeView::GetUint64() const {
+  char tag = Tag(Word());
+  assert(tag == 'l' || tag == 'u');
+  uint64_t u = doc_->words_[pos_ + 1];
+  assert(tag == 'u' || static_cast<int64_t>(u) >= 0);
+  return u;
+}
+
+const char* TapeView::GetString() const {
+  uint64_t w = Word();
+  assert(Tag(w) == '\"');
+  return doc_->strings_ + (w & kPayloadMask) + sizeof(uint32_t);
+}
+
+int TapeView::GetStringLength() const {
+  uint64_t w = Word();
+  assert(Tag(w) == '\"');
+  uint32_t n;
+  memcpy(&n, doc_->strings_ + (w & kPayloadMask), sizeof(n));
+  return static_cast<int>(n);
+}
+
+int TapeView::GetArraySize() const {
+  uint64_t w = Word();
+  assert(Tag(w) == '[');
+  int count = static_cast<int>((w >> 32) & kMaxCount);
+  if (count < kMaxCount) return count;
+  count = 0;
+  for (TapeView v = First(); v.Valid(); v = v.Next()) ++count;
+  return count;
+}
+
+TapeView TapeView::GetArrayValue(int index) const {
+  assert(Tag(Word()) == '[' && index >= 0);
+  TapeView v = First();
+  while (index-- > 0 && v.Valid()) v = v.Next();
+  return v;
+}
+
+int TapeView::GetObjectSize() const {
+  uint64_t w = Word();
+  assert(Tag(w) == '{');
+  int count = static_cast<int>((w >> 32) & kMaxCount);
+  if (count < kMaxCount) return count;
+  count = 0;
+  for (TapeView k = First(); k.Valid(); k = k.Next().Next()) ++count;
+  return count;
+}
+
+TapeView TapeView::GetObjectKey(int index) const {
+  assert(Tag(Word()) == '{' && index >= 0);
+  TapeView k = First();
+  while (index-- > 0 && k.Valid()) k = k.Next().Next();
+  return k;
+}
+
+TapeView TapeView::GetObjectValue(int index) const {
+  TapeView k = GetObjectKey(index);
+  return k.Valid() ? k.Next() : k;
+}
+
+TapeView TapeView::GetValueByKey(const char* k, int len) const {
+  assert(Tag(Word()) == '{' && k != NULL);
+  for (TapeView key = First(); key.Valid(); key = key.Next().Next()) {
+    if (key.GetStringLength() == len && memcmp(key.GetString(), k, len) == 0) {
+      return key.Next();
+    }
+  }
+  return TapeView();
+}
+
+TapeView TapeView::First() const {
+  char tag = Tag(Word());
+  assert(tag == '[' || tag == '{');
+  return At(pos_ + 1);
+}
+
+TapeView TapeView::Next() const {
+  return At(End());
+}
+
+} // namespace jsonutil
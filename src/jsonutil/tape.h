@@ -0,0 +1,110 @@
+#ifndef JSONUTIL_SRC_TAPE_H__
+#define JSONUTIL_SRC_TAPE_H__
+
+#include "json.h"
+#include "stack.h"
+#include "reader.h"
+#include "json_status.h"
+
+#include <stdint.h>
+
+namespace jsonutil {
+class TapeDocument;
+
+/* Read-only view of a value on the tape of a TapeDocument. It is two words
+ * and is passed by value; it stays valid until the document is parsed again
+ * or destroyed. Lookups that find nothing return a view whose Valid() is
+ * false. */
+class TapeView {
+ public:
+  TapeView() : doc_(NULL), pos_(0) {
+  }
+
+  bool Valid() const { return doc_ != NULL; }
+  ValueType Type() const;
+
+  /* True for kJSON_NUMBER, kJSON_INT64 and kJSON_UINT64. */
+  bool IsNumber() const;
+  bool GetBoolean() const;
+  /* Any numeric type, converted to double. */
+  double GetNumber() const;
+  int64_t GetInt64() const;
+  uint64_t GetUint64() const;
+  /* '\0'-terminated, but may hold '\0' too: pair with GetStringLength(). */
+  const char* GetString() const;
+  int GetStringLength() const;
+
+  /* Element and member access walk the container, skipping each subtree in
+   * O(1); the sizes are O(1) below 2^24 children. */
+  int GetArraySize() const;
+  TapeView GetArrayValue(int index) const;
+  int GetObjectSize() const;
+  /* The key (a string view) and the value of the @index-th member, in input
+   * order. */
+  TapeView GetObjectKey(int index) const;
+  TapeView GetObjectValue(int index) const;
+  /* The first member named @k; members are not sorted. */
+  TapeView GetValueByKey(const char* k, int len) const;
+
+  /* Cursor: First() is the first element of an array, or the first key of an
+   * object; Next() is the view after this one in its container, alternating
+   * between keys and values in an object. Both are invalid past the end. */
+  TapeView First() const;
+  TapeView Next() const;
+
+ private:
+  friend class TapeDocument;
+  TapeView(const TapeDocument* d, int p) : doc_(d), pos_(p) {
+  }
+
+  uint64_t Word() const;
+  /* Position just past this value. */
+  int End() const;
+  TapeView At(int pos) const;
+
+  const TapeDocument* doc_;
+  int pos_;
+};
+
+/* Immutable document stored as one flat tape of 64-bit words plus one
+ * string buffer, instead of a tree of separately allocated nodes. A value is
+ * one word, a tag in the top byte and a payload below it:
+ *   'n', 't', 'f'   null, true, false
+ *   'l', 'u', 'd'   int64, uint64, double; the number is the next word
+ *   '"'             payload is the offset of the string in the buffer,
+ *                   stored as a uint32_t length, the bytes and a '\0'
+ *   '[', '{'        payload bits 0-31 are the position just past the
+ *                   matching ']' or '}', bits 32-55 the number of children
+ *                   (saturated); the children follow, keys and values
+ *                   alternating in an object
+ *   ']', '}'        payload is the position of the opening word
+ * Parsing reuses the tape, the buffer and the reader's scratch space. */
+class TapeDocument {
+ public:
+  TapeDocument() : words_(NULL), size_(0), strings_(NULL) {
+  }
+
+  /* Same status codes as Value::Parse. On error the document is empty. */
+  JsonStatus Parse(const char* text, int len);
+  /* The root value, invalid if the document is empty. */
+  TapeView Root() const { return size_ ? TapeView(this, 0) : TapeView(); }
+  /* Tape length in words. */
+  int TapeSize() const { return size_; }
+
+ private:
+  /* TapeDocument is noncopyable. */
+  TapeDocument(const TapeDocument&);
+  const TapeDocument& operator=(const TapeDocument&);
+
+  friend class TapeView;
+
+  Stack tape_;
+  Stack buf_;
+  Reader reader_;
+  const uint64_t* words_; /* tape_ and buf_ once parsed */
+  int size_;
+  const char* strings_;
+};
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_TAPE_H__
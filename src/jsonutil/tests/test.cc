@@ -1,9 +1,20 @@
 #include "jsonutil/json.h"
 #include "jsonutil/json_status.h"
+#include "jsonutil/simd.h"
+#include "jsonutil/reader.h"
+#include "jsonutil/push_parser.h"
+#include "jsonutil/ndjson.h"
+#include "jsonutil/tape.h"
+#include "jsonutil/lazy.h"
+#include "jsonutil/string_pool.h"
+#include "jsonutil/validate.h"
+#include "jsonutil/writer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <iostream>
 #include <sstream>
@@ -47,6 +58,11 @@ using namespace std;
   TEST_EQUAL_CHECK(answer, result, __func__, __LINE__, \
     (static_cast<int>(answer) == static_cast<int>(result)))
 
+JsonStatus ParseImpl(Value& val, const char* text) {
+  int len = static_cast<int>(strlen(text));
+  return val.Parse(text, len);
+}
+
 void TestParseNull() {
   Value val;
   val.SetBoolean(true);
@@ -117,6 +133,15 @@ void TestParseNumber() {
   TestParseValidNumber(1, "1e-");
   TestParseValidNumber(1, "1e+");
   TestParseValidNumber(1, "1.e");
+  TestParseValidNumber(0.1, "0.1");
+  TestParseValidNumber(1.0000000000000002, "1.0000000000000002");
+  TestParseValidNumber(9007199254740992.0, "9007199254740993");
+  TestParseValidNumber(1.7976931348623157e308, "1.7976931348623157e308");
+  TestParseValidNumber(2.2250738585072014e-308, "2.2250738585072014e-308");
+  TestParseValidNumber(4.9406564584124654e-324, "4.9406564584124654e-324");
+  TestParseValidNumber(1.2345678901234567e29, "123456789012345678901234567890");
+  TestParseValidNumber(1.234e-40, "0.0000000000000000000000000000000000000001234");
+  TestParseValidNumber(0.0, "0e-10000");
 
   /* test invalid number */
   TestParseInvalidNumber("+0");
@@ -127,6 +152,8 @@ void TestParseNumber() {
   TestParseInvalidNumber("inf");
   TestParseInvalidNumber("NAN");
   TestParseInvalidNumber("nan"); 
+  TestParseInvalidNumber("0123");
+  TestParseInvalidNumber("-a");
 
   /* test under/overflow number */
   Value val;
@@ -135,6 +162,100 @@ void TestParseNumber() {
   TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_NUMBER_OVERFLOW, val.Parse("-1e+10000", 9).Code());
   val.Reset();
   TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_NUMBER_UNDERFLOW, val.Parse("1e-10000", 8).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_NUMBER_UNDERFLOW, val.Parse("-1e-400", 7).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_NUMBER_OVERFLOW, val.Parse("1.8e308", 7).Code());
+
+  /* numbers end at any delimiter */
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "{\"a\":-1.5e3}").Code());
+  TEST_EQUAL(-1500.0, val.GetValueByKey("a", 1)->GetNumber());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_ROOT_NOT_SINGULAR, ParseImpl(val, "1.2.3").Code());
+}
+
+void TestInt64() {
+  Value val;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "9007199254740993").Code());
+  TEST_EQUAL_INT(kJSON_INT64, val.Type());
+  TEST_EQUAL(9007199254740993LL, val.GetInt64());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "-9223372036854775808").Code());
+  TEST_EQUAL_INT(kJSON_INT64, val.Type());
+  TEST_EQUAL(INT64_MIN, val.GetInt64());
+  TEST_EQUAL(string("-9223372036854775808"), string(val.ToString().c_str()));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "9223372036854775807").Code());
+  TEST_EQUAL(INT64_MAX, val.GetInt64());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "18446744073709551615").Code());
+  TEST_EQUAL_INT(kJSON_UINT64, val.Type());
+  TEST_EQUAL(UINT64_MAX, val.GetUint64());
+  TEST_EQUAL(string("18446744073709551615"), string(val.ToString().c_str()));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "10000000000000000000").Code());
+  TEST_EQUAL(10000000000000000000ULL, val.GetUint64());
+
+  /* Out of 64-bit range, fractions, exponents and -0 stay doubles. */
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "18446744073709551616").Code());
+  TEST_EQUAL_INT(kJSON_NUMBER, val.Type());
+  TEST_EQUAL(18446744073709551616.0, val.GetNumber());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "-9223372036854775809").Code());
+  TEST_EQUAL_INT(kJSON_NUMBER, val.Type());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "1.0").Code());
+  TEST_EQUAL_INT(kJSON_NUMBER, val.Type());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "1e2").Code());
+  TEST_EQUAL_INT(kJSON_NUMBER, val.Type());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "-0").Code());
+  TEST_EQUAL_INT(kJSON_NUMBER, val.Type());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "0").Code());
+  TEST_EQUAL_INT(kJSON_INT64, val.Type());
+  TEST_EQUAL(string("0"), string(val.ToString().c_str()));
+
+  TEST_EQUAL(string("[0,-7,42,123456789012]"), string(
+    (ParseImpl(val, "[0, -7, 42, 123456789012]"), val.ToString().c_str())));
+
+  /* Setters keep one representation per value. */
+  val.SetUint64(5);
+  TEST_EQUAL_INT(kJSON_INT64, val.Type());
+  TEST_EQUAL(5u, val.GetUint64());
+  TEST_EQUAL(5.0, val.GetNumber());
+
+  Value a, b;
+  a.SetInt64(3);
+  b.SetNumber(3.0);
+  TEST_EQUAL(true, Compare(&a, &b));
+  b.SetUint64(UINT64_MAX);
+  TEST_EQUAL(false, Compare(&a, &b));
+  a = b;
+  TEST_EQUAL(true, Compare(&a, &b));
+
+  long long ll = 0;
+  unsigned long long ull = 0;
+  int i = 0;
+  double d = 0;
+  val << -12345678901234LL;
+  val >> ll;
+  TEST_EQUAL(-12345678901234LL, ll);
+  val << 18446744073709551615ULL;
+  val >> ull;
+  TEST_EQUAL(18446744073709551615ULL, ull);
+  val >> d;
+  TEST_EQUAL(18446744073709551615.0, d);
+  val << -42;
+  val >> i;
+  TEST_EQUAL(-42, i);
+  TEST_EQUAL_INT(kJSON_INT64, val.Type());
+
+  /* Integer targets take any numeric type holding an integral value. */
+  unsigned u = 0;
+  val.SetUint64(7);
+  val >> ll;
+  TEST_EQUAL(7LL, ll);
+  val.SetNumber(3.0);
+  val >> i;
+  TEST_EQUAL(3, i);
+  val >> ull;
+  TEST_EQUAL(3ULL, ull);
+  val.SetNumber(-9007199254740992.0);
+  val >> ll;
+  TEST_EQUAL(-9007199254740992LL, ll);
+  val.SetInt64(40);
+  val >> u;
+  TEST_EQUAL(40u, u);
 }
 
 #define TEST_EQUAL_STRING(ans, len1, res, len2) \
@@ -183,6 +304,70 @@ void TestParseStringInvalidImpl(JsonStatus error, const char* text, int t_len, i
 
 #define TestParseStringInvalid(error, text, len) \
   TestParseStringInvalidImpl(error, text, static_cast<int>(strlen(text)), len, __func__, __LINE__)
+/* Whether the bytes of string @v are stored inside @v itself. */
+bool IsInline(const Value& v) {
+  const char* p = v.GetString();
+  const char* self = reinterpret_cast<const char*>(&v);
+  return p >= self && p < self + sizeof(v);
+}
+
+void TestInlineString() {
+  const std::string texts[] = { "", "a", "thirteen byte", "fourteen bytes",
+                                std::string("nul\0inside", 10) };
+  bool ok = true;
+  for (int i = 0; i < 5; ++i) {
+    const std::string& t = texts[i];
+    int len = static_cast<int>(t.size());
+    Value v;
+    v.SetString(t.data(), len);
+    Value cp(v);
+    ok = ok && std::string(v.GetString(), v.GetStringLength()) == t
+         && v.GetString()[len] == '\0' && IsInline(v) == (len <= 13)
+         && std::string(cp.GetString(), cp.GetStringLength()) == t
+         && IsInline(cp) == (len <= 13) && Compare(&v, &cp);
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+
+  /* From a long string to a short one and back. */
+  Value v;
+  v.SetString("a string longer than fifteen", 28);
+  v.SetString("short", 5);
+  bool inl = IsInline(v);
+  TEST_EQUAL_INT(true, inl);
+  TEST_EQUAL_STRING("short", 5, v.GetString(), v.GetStringLength());
+  v.SetString("another string longer than fifteen", 34);
+  inl = IsInline(v);
+  TEST_EQUAL_INT(false, inl);
+  TEST_EQUAL_INT(34, v.GetStringLength());
+  v.Reset(kJSON_STRING);
+  bool null_str = v.GetString() == NULL && v.GetStringLength() == 0;
+  TEST_EQUAL_INT(true, null_str);
+
+  /* Parsed short strings, escaped or not, from every tree builder. */
+  const char* text = "[\"\", \"x\", \"tab\\there\", \"\\u0041-\\u0042 thirteen!\", \"\\u0041-\\u0042 fourteen!!\"]";
+  int len = static_cast<int>(strlen(text));
+  Value val, res;
+  Document doc;
+  JsonStatus s1 = val.Parse(text, len);
+  JsonStatus s2 = doc.Parse(text, len);
+  JsonStatus s3;
+  {
+    ValueHandler vh(res);
+    Reader r;
+    s3 = r.Parse(text, len, vh);
+  }
+  ok = s1.Ok() && s2.Ok() && s3.Ok() && Compare(&val, &doc) && Compare(&val, &res);
+  for (int i = 0; ok && i < 5; ++i) {
+    bool small = val.GetArrayValue(i)->GetStringLength() <= 13;
+    ok = IsInline(*val.GetArrayValue(i)) == small && IsInline(*doc.GetArrayValue(i)) == small
+         && IsInline(*res.GetArrayValue(i)) == small;
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+  TEST_EQUAL_STRING("tab\there", 8, val.GetArrayValue(2)->GetString(), val.GetArrayValue(2)->GetStringLength());
+  TEST_EQUAL(std::string("[\"\",\"x\",\"tab\\there\",\"A-B thirteen!\",\"A-B fourteen!!\"]"),
+             std::string(val.ToString().c_str()));
+}
+
 void TestParseString() {
   TestParseStringValid("", "\"\"", 0);
   TestParseStringValid("json", "\"json\"", 4);
@@ -254,7 +439,7 @@ void TestParseArray() {
   TestParseValueValid(val.GetArrayValue(0), &ary0);
   Value* res = val.GetArrayValue(1);
   TEST_EQUAL_INT(kJSON_ARRAY, res->Type());
-  TEST_EQUAL_INT(kJSON_NUMBER, (res->GetArrayValue(0))->Type());
+  TEST_EQUAL_INT(kJSON_INT64, (res->GetArrayValue(0))->Type());
   
   TestParseValueValid(val.GetArrayValue(1), &ary1);
   TestParseValueValid(val.GetArrayValue(2), &str_val);
@@ -280,11 +465,6 @@ void TestParseArray() {
   TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA, val0.Parse("[1 1]", 5).Code());
 }
 
-JsonStatus ParseImpl(Value& val, const char* text) {
-  int len = static_cast<int>(strlen(text));
-  return val.Parse(text, len);
-}
-
 void TestParseObject() {
   Value obj, va, vb, vc;
   
@@ -363,6 +543,958 @@ void TestParseObject() {
   TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET, ParseImpl(val0, "{\"abc\":null \"cde\"}").Code());  
 }
 
+void TestObjectOrder() {
+  /* A large object in scrambled key order comes out sorted. */
+  const int kNum = 20000;
+  std::string text = "{";
+  for (int i = 0; i < kNum; ++i) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s\"k%d\":%d", i ? "," : "", (i * 7919) % kNum, i);
+    text += buf;
+  }
+  text += "}";
+  int len = static_cast<int>(text.size());
+  Value val;
+  Document doc;
+  JsonStatus s1 = val.Parse(text.c_str(), len);
+  JsonStatus s2 = doc.Parse(text.c_str(), len, kPARSE_TWO_STAGE);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, s1.Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, s2.Code());
+  TEST_EQUAL_INT(kNum, val.GetObjectSize());
+  bool sorted = true;
+  for (int i = 1; i < val.GetObjectSize(); ++i) {
+    const Member* a = val.GetObjectMember(i - 1);
+    const Member* b = val.GetObjectMember(i);
+    if (Compare(a->Key(), a->KLen(), b->Key(), b->KLen()) > 0) sorted = false;
+  }
+  TEST_EQUAL_INT(true, sorted);
+  bool found = true;
+  for (int i = 0; i < kNum; ++i) {
+    char key[16];
+    int klen = snprintf(key, sizeof(key), "k%d", (i * 7919) % kNum);
+    const Value* v = val.GetValueByKey(key, klen);
+    if (v == NULL || v->GetInt64() != i) found = false;
+  }
+  TEST_EQUAL_INT(true, found);
+  bool missing = val.GetValueByKey("k", 1) == NULL
+                 && val.GetValueByKey("k200000", 7) == NULL;
+  TEST_EQUAL_INT(true, missing);
+  bool equal = Compare(&val, &doc);
+  TEST_EQUAL_INT(true, equal);
+
+  /* Duplicate keys keep their input order; lookups find the last one. */
+  const char* dup = "{\"b\":1, \"a\":2, \"ab\":3, \"a\":4, \"b\":5, \"a\":6}";
+  Value ans, res;
+  JsonStatus st = ans.Parse(dup, static_cast<int>(strlen(dup)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL(std::string("{\"a\":2,\"a\":4,\"a\":6,\"ab\":3,\"b\":1,\"b\":5}"),
+             std::string(ans.ToString().c_str()));
+  TEST_EQUAL_INT(6, ans.GetValueByKey("a", 1)->GetInt64());
+  TEST_EQUAL_INT(5, ans.GetValueByKey("b", 1)->GetInt64());
+  TEST_EQUAL_INT(3, ans.GetValueByKey("ab", 2)->GetInt64());
+  {
+    ValueHandler vh(res);
+    Reader r;
+    st = r.Parse(dup, static_cast<int>(strlen(dup)), vh);
+  }
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  equal = Compare(&ans, &res);
+  TEST_EQUAL_INT(true, equal);
+
+  /* Merged members go after existing ones with the same key. */
+  Value obj;
+  st = obj.Parse("{\"a\":1, \"c\":2}", 14);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  Builder<Member> store;
+  Value v3, v4, v5;
+  v3.SetInt64(3);
+  v4.SetInt64(4);
+  v5.SetInt64(5);
+  Member m3, m4, m5;
+  m3.Set("c", 1, &v3);
+  m4.Set("b", 1, &v4);
+  m5.Set("a", 1, &v5);
+  store << m3;
+  store << m4;
+  store << m5;
+  obj.MergeObjectBuilder(store);
+  TEST_EQUAL(std::string("{\"a\":1,\"a\":5,\"b\":4,\"c\":2,\"c\":3}"),
+             std::string(obj.ToString().c_str()));
+  Value empty(kJSON_OBJECT);
+  missing = empty.GetValueByKey("a", 1) == NULL;
+  TEST_EQUAL_INT(true, missing);
+}
+
+/* Every key of @obj (named "k<i>" with value i) is found, others are not. */
+bool LookupAll(const Value& obj, int num) {
+  bool ok = true;
+  for (int i = 0; i < num; ++i) {
+    char key[16];
+    int klen = snprintf(key, sizeof(key), "k%d", i);
+    const Value* v = obj.GetValueByKey(key, klen);
+    if (v == NULL || v->GetInt64() != i) ok = false;
+  }
+  return ok && obj.GetValueByKey("k", 1) == NULL && obj.GetValueByKey("x0", 2) == NULL
+         && obj.GetValueByKey("", 0) == NULL;
+}
+
+void TestObjectIndex() {
+  /* Around the size where objects start carrying a hash index. */
+  const int kMin = JSONUTIL_OBJECT_INDEX_MIN;
+  const int sizes[] = { kMin - 1, kMin, kMin + 1, 3 * kMin + 7 };
+  bool ok = true;
+  for (int n = 0; n < 4; ++n) {
+    std::string text = "{";
+    for (int i = 0; i < sizes[n]; ++i) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%s\"k%d\":%d", i ? "," : "", i, i);
+      text += buf;
+    }
+    text += "}";
+    int len = static_cast<int>(text.size());
+    Value val, res;
+    Document doc;
+    JsonStatus s1 = val.Parse(text.c_str(), len);
+    JsonStatus s2 = doc.Parse(text.c_str(), len);
+    JsonStatus s3;
+    {
+      ValueHandler vh(res);
+      Reader r;
+      s3 = r.Parse(text.c_str(), len, vh);
+    }
+    Value cp(val);
+    ok = ok && s1.Ok() && s2.Ok() && s3.Ok();
+    ok = ok && LookupAll(val, sizes[n]) && LookupAll(doc, sizes[n])
+         && LookupAll(res, sizes[n]) && LookupAll(cp, sizes[n]);
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+
+  /* The index follows changes to the object. */
+  Value obj(kJSON_OBJECT);
+  for (int i = 0; i < 2 * kMin; i += kMin / 2) {
+    Builder<Member> store;
+    for (int j = i; j < i + kMin / 2; ++j) {
+      char key[16];
+      int klen = snprintf(key, sizeof(key), "k%d", j);
+      Value v;
+      v.SetInt64(j);
+      Member m;
+      m.Set(key, klen, &v);
+      store << m;
+    }
+    obj.MergeObjectBuilder(store);
+    ok = LookupAll(obj, i + kMin / 2);
+    TEST_EQUAL_INT(true, ok);
+  }
+  JsonStatus st;
+  Value big;
+  big.SetInt64(-1);
+  bool set = obj.SetObjectKeyValue("k3", 2, &big);
+  TEST_EQUAL_INT(true, set);
+  TEST_EQUAL_INT(-1, obj.GetValueByKey("k3", 2)->GetInt64());
+  set = obj.SetObjectKeyValue("k-1", 3, &big);
+  TEST_EQUAL_INT(false, set);
+  /* Merging into a Document's object moves its members off the arena. */
+  Document doc;
+  st = doc.Parse("{\"k0\":0}", 8);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  Builder<Member> more;
+  more << *obj.GetMemberByKey("k1", 2);
+  doc.MergeObjectBuilder(more);
+  ok = LookupAll(doc, 2);
+  TEST_EQUAL_INT(true, ok);
+  doc.Reset();
+
+  /* Duplicate keys: the last one wins, as in small objects. */
+  std::string dup = "{";
+  for (int i = 0; i < kMin; ++i) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "\"k%d\":%d,", i % 4, i);
+    dup += buf;
+  }
+  dup += "\"k1\":-5}";
+  Value val;
+  st = val.Parse(dup.c_str(), static_cast<int>(dup.size()));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_INT(kMin - 4, val.GetValueByKey("k0", 2)->GetInt64());
+  TEST_EQUAL_INT(-5, val.GetValueByKey("k1", 2)->GetInt64());
+  TEST_EQUAL_INT(kMin - 1, val.GetValueByKey("k3", 2)->GetInt64());
+}
+
+void TestKey() {
+  /* Keys that share lengths or 8-byte prefixes, in a small and a large
+   * (indexed) object. */
+  const char* names[] = { "", "a", "id", "abcdefgh", "abcdefgx", "abcdefghi",
+                          "abcdefghij", "abcdefgh\\u0000", "user_name_long_key" };
+  const int kNames = 9;
+  for (int big = 0; big < 2; ++big) {
+    std::string text = "{";
+    for (int i = 0; i < kNames; ++i) {
+      text += std::string(i ? "," : "") + "\"" + names[i] + "\":" + std::to_string(i);
+    }
+    for (int i = 0; big && i < JSONUTIL_OBJECT_INDEX_MIN; ++i) {
+      text += ",\"pad" + std::to_string(i) + "\":-1";
+    }
+    text += ",\"id\":-2}";
+    Value obj;
+    JsonStatus st = obj.Parse(text.c_str(), static_cast<int>(text.size()));
+    TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+    bool ok = true;
+    for (int i = 0; i < obj.GetObjectSize(); ++i) {
+      const Member* m = obj.GetObjectMember(i);
+      Key key(m->Key(), m->KLen());
+      ok = ok && obj.GetMemberByKey(key) == obj.GetMemberByKey(m->Key(), m->KLen());
+    }
+    TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+    static const Key kId("id");
+    TEST_EQUAL_INT(-2, obj.GetValueByKey(kId)->GetInt64());
+    TEST_EQUAL_INT(5, obj.GetValueByKey(Key("abcdefghi"))->GetInt64());
+    TEST_EQUAL_INT(3, obj.GetValueByKey(Key(std::string("abcdefgh")))->GetInt64());
+    std::string nul("abcdefgh\0", 9);
+    TEST_EQUAL_INT(7, obj.GetValueByKey(Key(nul))->GetInt64());
+    TEST_EQUAL_INT(0, obj.GetValueByKey(Key("", 0))->GetInt64());
+    bool missing = obj.GetValueByKey(Key("abcdefgy")) == NULL
+                   && obj.GetValueByKey(Key("abcdefghk")) == NULL
+                   && obj.GetValueByKey(Key("i")) == NULL
+                   && obj.GetValueByKey(Key("user_name_long_kez")) == NULL;
+    TEST_EQUAL_INT(true, missing);
+  }
+  Value empty(kJSON_OBJECT);
+  bool missing = empty.GetValueByKey(Key("id")) == NULL;
+  TEST_EQUAL_INT(true, missing);
+
+  /* Map extraction keeps the last of duplicate keys and merges into what
+   * the map already holds. */
+  const char* text = "{\"b\":2, \"a\":1, \"b\":3, \"d\":4}";
+  Value obj;
+  JsonStatus st = obj.Parse(text, static_cast<int>(strlen(text)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  map<string, double> m;
+  m["c"] = 9;
+  m["d"] = 9;
+  obj >> m;
+  TEST_EQUAL_INT(4, static_cast<int>(m.size()));
+  TEST_EQUAL(1, m["a"]);
+  TEST_EQUAL(3, m["b"]);
+  TEST_EQUAL(9, m["c"]);
+  TEST_EQUAL(4, m["d"]);
+}
+
+void TestCompactLayout() {
+  TEST_EQUAL_INT(16, static_cast<int>(sizeof(Value)));
+  bool fits = sizeof(Member) <= 32;
+  TEST_EQUAL_INT(true, fits);
+
+  /* Member values live in the member block, from every tree builder. */
+  const char* text = "{\"n\":1, \"s\":\"a string too long to be inline\", \"o\":{\"a\":[1, {\"b\":null}]}}";
+  int len = static_cast<int>(strlen(text));
+  Value val, res;
+  Document doc;
+  JsonStatus s1 = val.Parse(text, len);
+  JsonStatus s2 = doc.Parse(text, len);
+  JsonStatus s3;
+  {
+    ValueHandler vh(res);
+    Reader r;
+    s3 = r.Parse(text, len, vh);
+  }
+  bool ok = s1.Ok() && s2.Ok() && s3.Ok() && Compare(&val, &doc) && Compare(&val, &res);
+  const Value* trees[] = { &val, &doc, &res };
+  for (int t = 0; ok && t < 3; ++t) {
+    for (int i = 0; ok && i < trees[t]->GetObjectSize(); ++i) {
+      const Member* m = trees[t]->GetObjectMember(i);
+      const char* v = reinterpret_cast<const char*>(m->Val());
+      ok = v >= reinterpret_cast<const char*>(m) && v < reinterpret_cast<const char*>(m + 1);
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+
+  /* MoveValue takes the payload of a malloc'd node and frees the node. */
+  Member mem;
+  mem.SetKey("k", 1);
+  Value* node = static_cast<Value*>(calloc(1, sizeof(Value)));
+  node->Parse("[\"a string too long to be inline\", {\"x\":[]}]", 44);
+  mem.MoveValue(node);
+  TEST_EQUAL_INT(2, mem.Val()->GetArraySize());
+  Member cp(mem);
+  bool copied = Compare(cp.Val(), mem.Val())
+                && cp.Val()->GetArrayValue(0)->GetString() != mem.Val()->GetArrayValue(0)->GetString();
+  TEST_EQUAL_INT(true, copied);
+  Value one;
+  one.SetInt64(1);
+  cp.SetValue(&one);
+  TEST_EQUAL_INT(1, cp.Val()->GetInt64());
+  TEST_EQUAL(std::string("[\"a string too long to be inline\",{\"x\":[]}]"),
+             std::string(mem.Val()->ToString().c_str()));
+
+  /* Builders and map conversion write straight into the members. */
+  map<string, vector<int> > in, out;
+  in["a"] = vector<int>(3, 7);
+  in["b"] = vector<int>();
+  in["a string too long to be inline"] = vector<int>(1, -1);
+  Value obj;
+  obj << in;
+  Value copy(obj);
+  copy >> out;
+  bool same = in == out && Compare(&obj, &copy);
+  TEST_EQUAL_INT(true, same);
+}
+
+void TestStringPool() {
+  StringPool pool(24);
+  const char* a = pool.Intern("key", 3);
+  std::string copy("key");
+  bool same = a == pool.Intern(copy.c_str(), 3) && a != pool.Intern("ke", 2)
+              && strcmp(a, "key") == 0 && pool.Intern("", 0) == pool.Intern("x", 0);
+  TEST_EQUAL_INT(true, same);
+  TEST_EQUAL_INT(3, pool.Size());
+
+  /* Trees parsed through the pool share their keys and short strings;
+   * strings that fit inside a Value stay there. */
+  const char* text0 = "{\"id\":\"a medium-size string\", \"na\\u006de\":\"a string too long to pool\", "
+                      "\"tags\":[{\"id\":\"abc\"}]}";
+  const char* text1 = "{\"tags\":null, \"id\":\"a medium-size string\"}";
+  ParseContext ctx(&pool);
+  Value v0, v1, ans;
+  Document doc;
+  JsonStatus s0 = v0.Parse(ctx, text0, static_cast<int>(strlen(text0)));
+  JsonStatus s1 = doc.Parse(ctx, text1, static_cast<int>(strlen(text1)), kPARSE_TWO_STAGE);
+  JsonStatus s2 = ans.Parse(text0, static_cast<int>(strlen(text0)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, s0.Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, s1.Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, s2.Code());
+  TestParseValueValid(&ans, &v0);
+  const char* id = pool.Intern("id", 2);
+  same = v0.GetMemberByKey("id", 2)->Key() == id && doc.GetMemberByKey("id", 2)->Key() == id
+         && v0.GetMemberByKey("name", 4)->Key() == pool.Intern("name", 4)
+         && v0.GetValueByKey("tags", 4)->GetArrayValue(0)->GetMemberByKey("id", 2)->Key() == id
+         && v0.GetValueByKey("id", 2)->GetString() == doc.GetValueByKey("id", 2)->GetString()
+         && v0.GetValueByKey("name", 4)->GetString() != pool.Intern("a string too long to pool", 25)
+         && pool.Size() == 8;
+  TEST_EQUAL_INT(true, same);
+  same = v0.GetValueByKey(Key(id, 2)) == v0.GetValueByKey("id", 2);
+  TEST_EQUAL_INT(true, same);
+  Value cp(v0);
+  bool equal = Compare(&cp, &v0) && Compare(&ans, &v0);
+  TEST_EQUAL_INT(true, equal);
+  cp.Reset();
+  v0.Reset();
+  doc.Reset();
+
+  /* A full pool falls back to copying. */
+  StringPool tiny(0, 0);
+  ParseContext tctx(&tiny);
+  s0 = v0.Parse(tctx, text0, static_cast<int>(strlen(text0)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, s0.Code());
+  TestParseValueValid(&ans, &v0);
+  TEST_EQUAL_INT(0, tiny.Size());
+
+  /* One pool shared by the NDJSON workers. */
+  std::string lines;
+  for (int i = 0; i < 2000; ++i) {
+    lines += "{\"user\":" + std::to_string(i) + ", \"k" + std::to_string(i % 50) + "\":true}\n";
+  }
+  StringPool shared;
+  NdjsonReader reader(4);
+  reader.SetStringPool(&shared);
+  Value docs;
+  JsonStatus st = reader.Parse(lines.c_str(), lines.size(), docs);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  const char* user = shared.Intern("user", 4);
+  same = docs.GetArraySize() == 2000;
+  for (int i = 0; same && i < docs.GetArraySize(); ++i) {
+    same = docs.GetArrayValue(i)->GetMemberByKey("user", 4)->Key() == user;
+  }
+  TEST_EQUAL_INT(true, same);
+  TEST_EQUAL_INT(51, shared.Size());
+}
+
+void TestDocument() {
+  Document doc;
+  Value val;
+  const char* text0 = "{\"c\":null, \"b\": [0, \"x\", [true]], \"a\": \"abc\"}";
+  int text0_len = static_cast<int>(strlen(text0));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, doc.Parse(text0, text0_len).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, val.Parse(text0, text0_len).Code());
+  TEST_EQUAL_INT(kJSON_OBJECT, doc.Type());
+  TEST_EQUAL_INT(3, doc.GetObjectSize());
+  TestParseValueValid(&doc, &val);
+  const Member* mem0 = doc.GetObjectMember(0);
+  TEST_EQUAL_STRING("a", 1, mem0->Key(), mem0->KLen());
+  TEST_EQUAL_STRING("abc", 3, mem0->Val()->GetString(), mem0->Val()->GetStringLength());
+  TEST_EQUAL_INT(3, doc.GetValueByKey("b", 1)->GetArraySize());
+  TEST_EQUAL(std::string(val.ToString()), std::string(doc.ToString()));
+
+  /* A deep copy leaves the arena behind. */
+  Value cp(doc);
+  doc.Reset();
+  TEST_EQUAL_INT(kJSON_NULL, doc.Type());
+  TestParseValueValid(&cp, &val);
+
+  /* Resetting a node inside the tree only detaches it. */
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, doc.Parse("[\"abc\", [1]]", 12).Code());
+  doc.GetArrayValue(0)->Reset();
+  TEST_EQUAL_INT(kJSON_NULL, doc.GetArrayValue(0)->Type());
+  TEST_EQUAL_INT(1, doc.GetArrayValue(1)->GetArraySize());
+
+  /* Appending to an inner array moves its elements out of the arena. */
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, doc.Parse("[[1,2,3],{\"a\":[4]}]", 19).Code());
+  Value five;
+  five << 5;
+  Builder<Value> tail;
+  tail << five;
+  Value* inner = doc.GetArrayValue(0);
+  inner->MergeArrayBuilder(tail);
+  TEST_EQUAL_INT(4, inner->GetArraySize());
+  TEST_EQUAL_INT(3, inner->GetArrayValue(2)->GetInt64());
+  TEST_EQUAL_INT(5, inner->GetArrayValue(3)->GetInt64());
+  TEST_EQUAL(std::string("[[1,2,3,5],{\"a\":[4]}]"), std::string(doc.ToString().c_str()));
+  inner->MergeArrayBuilder(tail);
+  TEST_EQUAL_INT(4, inner->GetArraySize());
+  inner->Reset();
+
+  /* Errors in nested containers release the partial tree. */
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA, doc.Parse("[[1, \"a\" 2]]", 13).Code());
+  TEST_EQUAL_INT(kJSON_NULL, doc.Type());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_INVALID_VALUE, val.Parse("[[1, x]]", 8).Code());
+  TEST_EQUAL_INT(kJSON_NULL, val.Type());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON, 
+                 ParseImpl(val, "{\"a\":{\"b\":[\"c\"], \"d\" 1}}").Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_ROOT_NOT_SINGULAR, val.Parse("[1] x", 5).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "[ ]").Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "{ }").Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ParseImpl(val, "[ null , [ true ] ]").Code());
+  TEST_EQUAL_INT(2, val.GetArraySize());
+}
+
+void TestParseInsitu() {
+  char text0[] = "{\"k\\u00e9y\" : [\"a\\tb\", \"plain\"], \"z\":\"\\uD834\\uDD1E\"}";
+  int len = static_cast<int>(strlen(text0));
+  const char* begin = text0;
+  const char* end = text0 + len;
+  Value val, ans;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ans.Parse(text0, len).Code());
+  /* The check macros evaluate their arguments twice. */
+  JsonStatus s = val.ParseInsitu(text0, len);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, s.Code());
+  TestParseValueValid(&ans, &val);
+  const Member* mem0 = val.GetObjectMember(0);
+  TEST_EQUAL_STRING("k\xC3\xA9y", 4, mem0->Key(), mem0->KLen());
+  TEST_EQUAL(true, (mem0->Key() >= begin && mem0->Key() < end));
+  const Value* tab = mem0->Val()->GetArrayValue(0);
+  TEST_EQUAL_STRING("a\tb", 3, tab->GetString(), tab->GetStringLength());
+  TEST_EQUAL(true, (tab->GetString() >= begin && tab->GetString() < end));
+  TEST_EQUAL_INT(0, strcmp("plain", mem0->Val()->GetArrayValue(1)->GetString()));
+  const Value* clef = val.GetValueByKey("z", 1);
+  TEST_EQUAL_STRING("\xF0\x9D\x84\x9E", 4, clef->GetString(), clef->GetStringLength());
+
+  /* Copies own their strings. */
+  Value cp(val);
+  val.Reset();
+  TestParseValueValid(&cp, &ans);
+
+  Document doc;
+  char text1[] = "[\"x\\ny\", {\"a\":\"b\"}]";
+  s = doc.ParseInsitu(text1, static_cast<int>(strlen(text1)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, s.Code());
+  TEST_EQUAL_STRING("x\ny", 3, doc.GetArrayValue(0)->GetString(), doc.GetArrayValue(0)->GetStringLength());
+  TEST_EQUAL_STRING("b", 1, doc.GetArrayValue(1)->GetValueByKey("a", 1)->GetString(), 1);
+
+  char text2[] = "[\"ok\", {\"a\" 1}]";
+  s = val.ParseInsitu(text2, static_cast<int>(strlen(text2)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON, s.Code());
+}
+
+void TestParseZeroCopy() {
+  const char* text0 = "{\"plain\" : [\"abc\", \"a\\\"b\"], \"esc\\u0041ped\":\"\"}";
+  int len = static_cast<int>(strlen(text0));
+  const char* end = text0 + len;
+  Value val, ans;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ans.Parse(text0, len).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, val.Parse(text0, len, kPARSE_ZERO_COPY).Code());
+  TestParseValueValid(&ans, &val);
+  const Member* esc = val.GetObjectMember(0);
+  const Member* plain = val.GetObjectMember(1);
+  TEST_EQUAL_STRING("escAped", 7, esc->Key(), esc->KLen());
+  TEST_EQUAL(false, (esc->Key() >= text0 && esc->Key() < end));
+  TEST_EQUAL_STRING("plain", 5, plain->Key(), plain->KLen());
+  TEST_EQUAL(true, (plain->Key() >= text0 && plain->Key() < end));
+  const Value* abc = plain->Val()->GetArrayValue(0);
+  TEST_EQUAL_STRING("abc", 3, abc->GetString(), abc->GetStringLength());
+  TEST_EQUAL(true, (abc->GetString() >= text0 && abc->GetString() < end));
+  const Value* quoted = plain->Val()->GetArrayValue(1);
+  TEST_EQUAL_STRING("a\"b", 3, quoted->GetString(), quoted->GetStringLength());
+  TEST_EQUAL(false, (quoted->GetString() >= text0 && quoted->GetString() < end));
+  TEST_EQUAL_INT(0, esc->Val()->GetStringLength());
+  TEST_EQUAL(std::string(ans.ToString()), std::string(val.ToString()));
+
+  Document doc;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, doc.Parse(text0, len, kPARSE_ZERO_COPY).Code());
+  TestParseValueValid(&ans, &doc);
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_STRING_NO_END_MARK, val.Parse("[\"abc", 5, kPARSE_ZERO_COPY).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_STRING_INVALID_CHAR, val.Parse("\"a\x01\"", 4, kPARSE_ZERO_COPY).Code());
+}
+
+/* Write @text to a new temporary file and return its path. */
+std::string WriteTempFile(const std::string& text) {
+  char path[] = "/tmp/jsonutil_test_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) return "";
+  ssize_t n = write(fd, text.data(), text.size());
+  close(fd);
+  return n == static_cast<ssize_t>(text.size()) ? path : "";
+}
+
+void TestParseFile() {
+  std::string text = "{\"plain\" : [\"abc\", 1.5, true], \"esc\\u0041ped\":\"x\\ty\"}";
+  std::string path = WriteTempFile(text);
+  Value ans;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ans.Parse(text.c_str(), static_cast<int>(text.size())).Code());
+  const int flags[] = { kPARSE_DEFAULT, kPARSE_ZERO_COPY, kPARSE_TWO_STAGE };
+  for (int i = 0; i < 3; ++i) {
+    Document doc;
+    JsonStatus st = doc.ParseFile(path.c_str(), flags[i]);
+    TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+    TestParseValueValid(&ans, &doc);
+  }
+  /* Zero-copy strings still refer to the mapping after ParseFile. */
+  Document doc;
+  JsonStatus st = doc.ParseFile(path.c_str(), kPARSE_ZERO_COPY);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  const Value* abc = doc.GetValueByKey("plain", 5)->GetArrayValue(0);
+  TEST_EQUAL_STRING("abc", 3, abc->GetString(), abc->GetStringLength());
+  TEST_EQUAL(std::string(ans.ToString()), std::string(doc.ToString()));
+
+  /* The in-situ parse writes to private pages only. */
+  st = doc.ParseFileInsitu(path.c_str());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TestParseValueValid(&ans, &doc);
+  std::string after;
+  FILE* f = fopen(path.c_str(), "rb");
+  char buf[256];
+  size_t n = f ? fread(buf, 1, sizeof(buf), f) : 0;
+  if (f) fclose(f);
+  after.assign(buf, n);
+  TEST_EQUAL(text, after);
+  doc.Reset();
+  unlink(path.c_str());
+
+  st = doc.ParseFile(path.c_str());
+  TEST_EQUAL_INT(JsonStatus::kJSON_FILE_IO_ERROR, st.Code());
+  st = doc.ParseFileInsitu("/");
+  TEST_EQUAL_INT(JsonStatus::kJSON_FILE_IO_ERROR, st.Code());
+  std::string empty = WriteTempFile("");
+  st = doc.ParseFile(empty.c_str());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_EXPECT_VALUE, st.Code());
+  st = doc.ParseFileInsitu(empty.c_str());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_EXPECT_VALUE, st.Code());
+  unlink(empty.c_str());
+  std::string bad = WriteTempFile("[1, 2");
+  st = doc.ParseFile(bad.c_str(), kPARSE_ZERO_COPY);
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA, st.Code());
+  unlink(bad.c_str());
+}
+
+void TestParseContext() {
+  const char* texts[] = {
+    "{\"a\" : [1, 2, {\"b\" : \"x\\ny\"}], \"c\" : null}",
+    "[\"abc\", 1e3, true, [[], {}]]",
+    "{\"a\" : [1, 2,]}", /* leaves a partial tree in the context */
+    "\"\\u00e9t\\u00e9\""
+  };
+  const int flags[] = { kPARSE_DEFAULT, kPARSE_ZERO_COPY, kPARSE_TWO_STAGE };
+  ParseContext ctx;
+  bool same = true;
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i) {
+      int len = static_cast<int>(strlen(texts[i]));
+      Value ans, val;
+      Document doc;
+      JsonStatus s1 = ans.Parse(texts[i], len, flags[round]);
+      JsonStatus s2 = val.Parse(ctx, texts[i], len, flags[round]);
+      JsonStatus s3 = doc.Parse(ctx, texts[i], len, flags[round]);
+      if (s1.Code() != s2.Code() || s1.Code() != s3.Code()) same = false;
+      if (!Compare(&ans, &val) || !Compare(&ans, &doc)) same = false;
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+  /* The buffers are kept across parses until released. */
+  int cap = ctx.Capacity();
+  bool kept = cap > 0;
+  TEST_EQUAL_INT(true, kept);
+  Value val;
+  JsonStatus st = val.Parse(ctx, texts[1], static_cast<int>(strlen(texts[1])));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_INT(cap, ctx.Capacity());
+  ctx.Release();
+  TEST_EQUAL_INT(0, ctx.Capacity());
+  st = val.Parse(ctx, texts[0], static_cast<int>(strlen(texts[0])));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+}
+
+void TestSimdScan() {
+  /* Kernels against the byte-at-a-time definition, at every offset. */
+  char buf[100];
+  bool ok = true;
+  for (int stop = 0; stop < 80; ++stop) {
+    for (int i = 0; i < 100; ++i) buf[i] = " \t\r\n"[i % 4];
+    buf[stop] = 'x';
+    for (int start = 0; start <= stop; ++start) {
+      ok = ok && (SkipWhitespace(buf + start, buf + 100) == buf + stop);
+      ok = ok && (SkipWhitespace(buf + start, buf + stop) == buf + stop);
+    }
+    const char stoppers[] = { '\"', '\\', '\x01', '\x1F' };
+    for (int k = 0; k < 4; ++k) {
+      for (int i = 0; i < 100; ++i) buf[i] = static_cast<char>(i % 2 ? 'a' : '\xE9');
+      buf[stop] = stoppers[k];
+      for (int start = 0; start <= stop; ++start) {
+        ok = ok && (ScanStringRun(buf + start, buf + 100) == buf + stop);
+      }
+    }
+  }
+  TEST_EQUAL_CHECK("-", SimdKernelName(), __func__, __LINE__, ok);
+
+  /* Long strings with escapes on and around vector boundaries. */
+  std::string text = "  \t\n  [\"";
+  std::string ans;
+  for (int i = 0; i < 70; ++i) {
+    text += (i % 17 == 0) ? "\\n" : "x";
+    ans += (i % 17 == 0) ? "\n" : "x";
+  }
+  text += "\"                                   ]   ";
+  Value val;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, val.Parse(text.c_str(), static_cast<int>(text.size())).Code());
+  const Value* elem = val.GetArrayValue(0);
+  TEST_EQUAL_STRING(ans.c_str(), static_cast<int>(ans.size()), elem->GetString(), elem->GetStringLength());
+  std::string bad = "\"" + std::string(40, 'a') + "\x02\"";
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_STRING_INVALID_CHAR, val.Parse(bad.c_str(), static_cast<int>(bad.size())).Code());
+}
+
+void TestTwoStage() {
+  /* Same trees as the default parser, with every token shifted across the
+   * 64-byte blocks of stage 1. */
+  std::string esc = "\"";
+  for (int i = 1; i <= 70; ++i) {
+    esc += (i % 9 == 0) ? "\\\\\\\"" : (i % 13 == 0) ? "\\u00e9" : "y";
+  }
+  esc += "\\\\\"";
+  const char* good[] = {
+    "null", " true ", "false", "0", "-12.5e-3", "18446744073709551615", "\"\"",
+    "\"a\\\"b\\\\c\\u00e9\\ud83d\\ude00\"", "[]", "[ ]", "{ }",
+    "[1,[2,[3,[]]],{\"k\":[true,null]}]",
+    "{\"b\": 1, \"a\": \"x\\ny\", \"c\": {\"d\": -0, \"e\": [1.5, 2]}}",
+    "  [ \"one\" , 2 , 3.0e2 , { } ]  ", "{\"k\\\"{\":[\"]\",\"\\\\\"]}", esc.c_str()
+  };
+  bool same = true;
+  for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); ++i) {
+    for (int pad = 0; pad < 70; ++pad) {
+      std::string text = std::string(pad, ' ') + good[i];
+      int len = static_cast<int>(text.size());
+      Value ans, res, zc;
+      Document doc;
+      bool ok = ans.Parse(text.c_str(), len).Ok()
+                && res.Parse(text.c_str(), len, kPARSE_TWO_STAGE).Ok()
+                && zc.Parse(text.c_str(), len, kPARSE_TWO_STAGE | kPARSE_ZERO_COPY).Ok()
+                && doc.Parse(text.c_str(), len, kPARSE_TWO_STAGE).Ok()
+                && Compare(&ans, &res) && Compare(&ans, &zc) && Compare(&ans, &doc);
+      if (!ok) {
+        same = false;
+        std::cout << good[i] << " after " << pad << " spaces" << std::endl;
+      }
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+
+  /* Same status codes. */
+  const char* bad[] = {
+    "", " ", "nul", "nulx", "truex", "-", "01", "1x", "1e400", "1.2.3", "[1-2]",
+    "\"abc", "\"ab\\", "\"\\x\"", "\"\\u12\"", "\"\\ud800\"", "\"a\x01\"",
+    "[", "[1", "[1,", "[1,]", "[1 2", "[1\"a\"]", "[\"a\"1]", "{", "{1:2}", "{\"a\"",
+    "{\"a\" 1}", "{\"a\":", "{\"a\":1", "{\"a\":1,", "{\"a\":1,}",
+    "{\"a\":1 \"b\"}", "[1] x", "[[1,x]]", "{\"a\":[\"\\q\"]}", "1 2", "]", "[}"
+  };
+  same = true;
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    for (int pad = 0; pad < 70; pad += 7) {
+      std::string text = std::string(pad, ' ') + bad[i];
+      int len = static_cast<int>(text.size());
+      Value val;
+      Document doc;
+      JsonStatus ans = val.Parse(text.c_str(), len);
+      JsonStatus res = val.Parse(text.c_str(), len, kPARSE_TWO_STAGE);
+      JsonStatus res_doc = doc.Parse(text.c_str(), len, kPARSE_TWO_STAGE);
+      if (ans.Code() != res.Code() || ans.Code() != res_doc.Code()) {
+        same = false;
+        std::cout << bad[i] << ": " << ans.ToString() << " vs " << res.ToString() << std::endl;
+      }
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+}
+
+/* @t holds the same value as @v; object members may come in another order. */
+bool SameAsTape(const Value* v, TapeView t) {
+  if (!t.Valid() || v->Type() != t.Type()) return false;
+  switch (v->Type()) {
+    case kJSON_FALSE:
+    case kJSON_TRUE:   return v->GetBoolean() == t.GetBoolean();
+    case kJSON_NUMBER: return v->GetNumber() == t.GetNumber();
+    case kJSON_INT64:  return v->GetInt64() == t.GetInt64();
+    case kJSON_UINT64: return v->GetUint64() == t.GetUint64();
+    case kJSON_STRING: return v->GetStringLength() == t.GetStringLength()
+                              && memcmp(v->GetString(), t.GetString(), v->GetStringLength()) == 0
+                              && t.GetString()[t.GetStringLength()] == '\0';
+    case kJSON_ARRAY: {
+      if (v->GetArraySize() != t.GetArraySize()) return false;
+      TapeView e = t.First();
+      for (int i = 0; i < v->GetArraySize(); ++i, e = e.Next()) {
+        if (!SameAsTape(v->GetArrayValue(i), e)) return false;
+        if (!SameAsTape(v->GetArrayValue(i), t.GetArrayValue(i))) return false;
+      }
+      return !e.Valid();
+    }
+    case kJSON_OBJECT: {
+      if (v->GetObjectSize() != t.GetObjectSize()) return false;
+      for (int i = 0; i < t.GetObjectSize(); ++i) {
+        TapeView k = t.GetObjectKey(i);
+        const Value* m = v->GetValueByKey(k.GetString(), k.GetStringLength());
+        if (m == NULL || !SameAsTape(m, t.GetObjectValue(i))) return false;
+        if (!SameAsTape(m, t.GetValueByKey(k.GetString(), k.GetStringLength()))) return false;
+      }
+      return true;
+    }
+    default: return true;
+  }
+}
+
+void TestTape() {
+  const char* good[] = {
+    "null", " true ", "false", "0", "-12.5e-3", "-9223372036854775808",
+    "18446744073709551615", "\"\"", "\"a\\\"b\\u0000c\\ud83d\\ude00\"", "[]", "{ }",
+    "[1,[2,[3,[]]],{\"k\":[true,null]}]",
+    "{\"b\": 1, \"a\": \"x\\ny\", \"c\": {\"d\": -0, \"e\": [1.5, 2]}, \"\": {}}"
+  };
+  bool same = true;
+  TapeDocument doc;
+  for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); ++i) {
+    Value ans;
+    JsonStatus st = ParseImpl(ans, good[i]);
+    bool ok = st.Ok() && doc.Parse(good[i], static_cast<int>(strlen(good[i]))).Ok()
+              && SameAsTape(&ans, doc.Root()) && !doc.Root().Next().Valid();
+    if (!ok) {
+      same = false;
+      std::cout << good[i] << std::endl;
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+
+  /* Members in input order; containers are skipped in one step. */
+  const char* text = "{\"z\": [[1, 2], {\"y\": [3]}], \"a\": 1.5, \"a\": 2}";
+  JsonStatus st = doc.Parse(text, static_cast<int>(strlen(text)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_INT(24, doc.TapeSize());
+  TapeView root = doc.Root();
+  TEST_EQUAL_INT(3, root.GetObjectSize());
+  TEST_EQUAL_STRING("z", 1, root.GetObjectKey(0).GetString(), root.GetObjectKey(0).GetStringLength());
+  TEST_EQUAL_INT(kJSON_NUMBER, root.First().Next().Next().Next().Type());
+  TEST_EQUAL(1.5, root.GetValueByKey("a", 1).GetNumber());
+  TEST_EQUAL_INT(2, root.GetObjectValue(2).GetInt64());
+  TEST_EQUAL_INT(3, root.GetObjectValue(0).GetArrayValue(1).GetValueByKey("y", 1).GetArrayValue(0).GetInt64());
+  TEST_EQUAL_INT(false, root.GetValueByKey("y", 1).Valid());
+  TEST_EQUAL_INT(false, root.GetObjectValue(0).GetArrayValue(2).Valid());
+
+  const char* bad[] = { "", "nul", "01", "\"abc", "[1,]", "{\"a\":1,}", "{\"a\" 1}", "[1] x" };
+  same = true;
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    Value val;
+    JsonStatus ans = ParseImpl(val, bad[i]);
+    JsonStatus res = doc.Parse(bad[i], static_cast<int>(strlen(bad[i])));
+    if (ans.Code() != res.Code() || doc.Root().Valid()) same = false;
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+}
+
+/* Materializes @v and checks it against the DOM parse of @text. */
+bool SameAsLazy(const char* text, LazyValue v) {
+  Value ans, res;
+  JsonStatus st = ParseImpl(ans, text);
+  return st.Ok() && v.GetValue(res).Ok() && Compare(&ans, &res);
+}
+
+void TestLazy() {
+  const char* text =
+    "{\"id\": 7, \"skip\": [1, {\"x\": \"]}\\\"\"}, [[]]], \"k\\u0065y\": true,"
+    " \"name\": \"a\\tb\", \"plain\": \"xy\", \"list\": [10, 20.5, null, false] }";
+  LazyDocument doc;
+  JsonStatus st = doc.Parse(text, static_cast<int>(strlen(text)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  LazyValue root = doc.Root();
+  TEST_EQUAL_INT(kJSON_OBJECT, root.Type());
+  int size = 0;
+  st = root.GetObjectSize(size);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_INT(6, size);
+
+  LazyValue v;
+  double d = 0;
+  st = root.GetValueByKey("id", 2, v);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = v.GetNumber(d);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL(7.0, d);
+  bool b = false;
+  st = root.GetValueByKey("key", 3, v);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = v.GetBoolean(b);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_INT(true, b);
+  const char* sp = NULL;
+  int len = 0;
+  st = root.GetValueByKey("name", 4, v);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = v.GetString(sp, len);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_STRING("a\tb", 3, sp, len);
+  st = root.GetValueByKey("plain", 5, v);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = v.GetString(sp, len);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_STRING("xy", 2, sp, len);
+  st = root.GetValueByKey("missing", 7, v);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_INT(false, v.Valid());
+
+  LazyValue list, elem;
+  st = root.GetValueByKey("list", 4, list);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = list.GetArraySize(size);
+  TEST_EQUAL_INT(4, size);
+  st = list.GetArrayValue(1, elem);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = elem.GetNumber(d);
+  TEST_EQUAL(20.5, d);
+  st = list.GetArrayValue(4, elem);
+  TEST_EQUAL_INT(false, elem.Valid());
+  st = root.GetValueByKey("skip", 4, v);
+  TEST_EQUAL_INT(true, SameAsLazy("[1, {\"x\": \"]}\\\"\"}, [[]]]", v));
+  TEST_EQUAL_INT(true, SameAsLazy(text, root));
+
+  /* Errors come back once a lookup runs into them, not before. */
+  const char* bad = "{\"a\": 1, \"b\": [1,,2], \"c\" 3, \"d\": 4}";
+  st = doc.Parse(bad, static_cast<int>(strlen(bad)));
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  root = doc.Root();
+  st = root.GetValueByKey("a", 1, v);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = root.GetValueByKey("b", 1, v);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  Value val;
+  st = v.GetValue(val);
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_INVALID_VALUE, st.Code());
+  st = root.GetValueByKey("d", 1, v);
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON, st.Code());
+
+  const char* cut[] = { "{\"a\": \"xy", "{\"a\": [1, 2", "{\"a\": 1,", "{\"a\": 1,}",
+                        "{\"a\": 1 \"b\": 2}", "{\"\\x\": 1}", "{\"a\":}" };
+  bool same = true;
+  for (size_t i = 0; i < sizeof(cut) / sizeof(cut[0]); ++i) {
+    JsonStatus ans = ParseImpl(val, cut[i]);
+    st = doc.Parse(cut[i], static_cast<int>(strlen(cut[i])));
+    JsonStatus res = doc.Root().GetValueByKey("z", 1, v);
+    if (ans.Code() != res.Code()) {
+      same = false;
+      std::cout << cut[i] << ": " << ans.ToString() << " vs " << res.ToString() << std::endl;
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+  st = doc.Parse("  ", 2);
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_EXPECT_VALUE, st.Code());
+}
+
+/* Writes the events back out as compact JSON. */
+struct EchoHandler {
+  EchoHandler() : out(), limit(-1) {
+  }
+  bool Put(const std::string& t) {
+    if (!out.empty() && out[out.size() - 1] != '[' && out[out.size() - 1] != '{'
+        && out[out.size() - 1] != ':') {
+      out += ",";
+    }
+    out += t;
+    return limit < 0 || --limit > 0;
+  }
+  bool Null() { return Put("null"); }
+  bool Bool(bool b) { return Put(b ? "true" : "false"); }
+  bool Int64(int64_t i) { return Put(std::to_string(i)); }
+  bool Uint64(uint64_t u) { return Put("u" + std::to_string(u)); }
+  bool Number(double d) { return Put("d" + std::to_string(d)); }
+  bool String(const char* s, int len) { return Put("\"" + std::string(s, len) + "\""); }
+  bool StartObject() { return Put("{"); }
+  bool Key(const char* s, int len) { return Put("\"" + std::string(s, len) + "\":"); }
+  bool EndObject(int size) { out += "}" + std::to_string(size); return true; }
+  bool StartArray() { return Put("["); }
+  bool EndArray(int size) { out += "]" + std::to_string(size); return true; }
+
+  std::string out;
+  int limit; /* abort on the limit-th Put */
+};
+
+struct CountHandler : public BaseHandler<CountHandler> {
+  CountHandler() : numbers(0), sum(0) {
+  }
+  bool Number(double d) { ++numbers; sum += d; return true; }
+
+  int numbers;
+  double sum;
+};
+
+JsonStatus ReaderImpl(Reader& r, EchoHandler& h, const char* text) {
+  h.out.clear();
+  return r.Parse(text, static_cast<int>(strlen(text)), h);
+}
+
+void TestReader() {
+  Reader r;
+  EchoHandler h;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ReaderImpl(r, h, " [null, true, false, 1, -2.5, 18446744073709551615] ").Code());
+  TEST_EQUAL(string("[null,true,false,1,d-2.500000,u18446744073709551615]6"), h.out);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ReaderImpl(r, h, "{\"a\\tb\": {\"c\": []}, \"d\": \"x\\u00e9y\"}").Code());
+  TEST_EQUAL(string("{\"a\tb\":{\"c\":[]0}1,\"d\":\"x\xC3\xA9y\"}2"), h.out);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, ReaderImpl(r, h, "{}").Code());
+  TEST_EQUAL(string("{}0"), h.out);
+
+  /* Same status codes as the DOM parser. */
+  const char* bad[] = {
+    "", " ", "nul", "tru", "-", "01", "1e400", "\"abc", "\"\\x\"", "\"\\u12\"",
+    "\"\\ud800\"", "[1,]", "[1 2", "{1:2}", "{\"a\" 1}", "{\"a\":1,}",
+    "{\"a\":1 \"b\"}", "[1] x", "[[1,x]]", "{\"a\":[\"\\q\"]}"
+  };
+  bool same = true;
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    Value val;
+    JsonStatus dom = ParseImpl(val, bad[i]);
+    JsonStatus sax = ReaderImpl(r, h, bad[i]);
+    if (dom.Code() != sax.Code()) {
+      same = false;
+      std::cout << bad[i] << ": " << dom.ToString() << " vs " << sax.ToString() << std::endl;
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+
+  h.limit = 3;
+  JsonStatus st = ReaderImpl(r, h, "[1, 2, 3, 4]");
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_HANDLER_ABORTED, st.Code());
+  TEST_EQUAL(string("[1,2"), h.out);
+  h.limit = -1;
+
+  CountHandler c;
+  const char* text = "{\"x\": [1, 2.5, \"3\", {\"y\": 4}]}";
+  st = r.Parse(text, static_cast<int>(strlen(text)), c);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL(3, c.numbers);
+  TEST_EQUAL(7.5, c.sum);
+}
+
 void TestJsonStringifyImpl(const char* s, const char* func, int line) {
   Value ans, res;
   ans.Parse(s, static_cast<int>(strlen(s)));
@@ -520,16 +1652,604 @@ void TestSerialize() {
   TestSerializeBuilderChaining();
 }
 
+/* Feeds @text in chunks of @step bytes, each from a scratch copy that is
+ * clobbered afterwards, so nothing may point into an earlier chunk. */
+template <typename Handler>
+JsonStatus PushImpl(PushParser<Handler>& pp, const std::string& text, int step) {
+  pp.Reset();
+  char chunk[64];
+  JsonStatus ret;
+  for (size_t i = 0; i < text.size() && ret.Ok(); i += step) {
+    int n = static_cast<int>(std::min(text.size() - i, static_cast<size_t>(step)));
+    memcpy(chunk, text.data() + i, n);
+    ret = pp.Feed(chunk, n);
+    memset(chunk, '#', sizeof(chunk));
+  }
+  if (ret.Ok()) ret = pp.Finish();
+  return ret;
+}
+
+void TestPushParser() {
+  const char* good[] = {
+    "null", " true ", "false", "0", "-12.5e-3", "123456789012345678901234567890",
+    "18446744073709551615", "\"\"", "\"plain\"", "\"a\\\"b\\\\c\\u00e9\\ud83d\\ude00\"",
+    "[]", "[ ]", "{ }", "[1,[2,[3,[]]],{\"k\":[true,null]}]",
+    "{\"b\": 1, \"a\": \"x\\ny\", \"c\": {\"d\": -0, \"e\": [1.5, 2]}}",
+    "  [ \"one\" , 2 , 3.0e2 , { } ]  "
+  };
+  bool same = true;
+  for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); ++i) {
+    std::string text = good[i];
+    Value ans;
+    Reader r;
+    EchoHandler echo_ans;
+    if (!ParseImpl(ans, good[i]).Ok() || !ReaderImpl(r, echo_ans, good[i]).Ok()) {
+      same = false;
+      continue;
+    }
+    for (int step = 1; step <= static_cast<int>(text.size()); ++step) {
+      Value res;
+      ValueHandler vh(res);
+      PushParser<ValueHandler> pp(vh);
+      EchoHandler echo;
+      PushParser<EchoHandler> pe(echo);
+      bool ok = PushImpl(pp, text, step).Ok() && Compare(&ans, &res)
+                && PushImpl(pe, text, step).Ok() && echo.out == echo_ans.out;
+      if (!ok) {
+        same = false;
+        std::cout << good[i] << " in chunks of " << step << std::endl;
+      }
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+
+  /* Same status codes as the DOM parser, wherever the input is split. */
+  const char* bad[] = {
+    "", " ", "nul", "nulx", "tru", "-", "01", "1e400", "1.2.3", "[1-2]",
+    "\"abc", "\"ab\\", "\"\\x\"", "\"\\u12\"", "\"\\u12", "\"\\ud800\"",
+    "\"a\x01\"", "[", "[1", "[1,", "[1,]", "[1 2", "{", "{1:2}", "{\"a\"",
+    "{\"a\" 1}", "{\"a\":", "{\"a\":1", "{\"a\":1,", "{\"a\":1,}",
+    "{\"a\":1 \"b\"}", "[1] x", "[[1,x]]", "{\"a\":[\"\\q\"]}", "1 2",
+    "\"\\ud83d\\ude\"00\"", "\"\\ud83d\\ud\ne00\"", "\"\\ud83d\\u\"", "\"\\ud83d\\\""
+  };
+  same = true;
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    std::string text = bad[i];
+    Value val;
+    JsonStatus dom = ParseImpl(val, bad[i]);
+    for (int step = 1; step <= static_cast<int>(text.size()) + 1; ++step) {
+      Value res;
+      ValueHandler vh(res);
+      PushParser<ValueHandler> pp(vh);
+      JsonStatus push = PushImpl(pp, text, step);
+      if (dom.Code() != push.Code()) {
+        same = false;
+        std::cout << bad[i] << ": " << dom.ToString() << " vs " << push.ToString() << std::endl;
+      }
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+
+  /* Errors stick until Reset(). */
+  Value v;
+  ValueHandler vh(v);
+  PushParser<ValueHandler> pp(vh);
+  JsonStatus st = pp.Feed("[1,", 3);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = pp.Feed("]", 1);
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_ARRAY_INVALID_EXTRA_COMMA, st.Code());
+  st = pp.Finish();
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_ARRAY_INVALID_EXTRA_COMMA, st.Code());
+  pp.Reset();
+  vh.Reset();
+  st = pp.Feed("{\"a\": [1, 2", 11);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = pp.Feed("]}", 2);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  st = pp.Finish();
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL_INT(kJSON_OBJECT, v.Type());
+  TEST_EQUAL(2, v.GetValueByKey("a", 1)->GetArraySize());
+}
+
+bool CollectId(Value& doc, void* arg) {
+  vector<int64_t>* ids = static_cast<vector<int64_t>*>(arg);
+  ids->push_back(doc.GetValueByKey("id", 2)->GetInt64());
+  return ids->size() < 5000;
+}
+
+void TestNdjson() {
+  /* Enough lines for several chunks, with blank and CRLF lines mixed in. */
+  std::string text;
+  const int kLines = 60000;
+  for (int i = 0; i < kLines; ++i) {
+    text += "{\"id\": " + std::to_string(i) + ", \"name\": \"item\", \"tags\": [1, 2, 3]}";
+    text += (i % 7 == 0) ? "\r\n\n" : "\n";
+  }
+  bool ok = true;
+  for (int threads = 1; threads <= 4; threads += 3) {
+    NdjsonReader r(threads);
+    Value docs;
+    JsonStatus st = r.Parse(text.c_str(), text.size(), docs);
+    TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+    TEST_EQUAL_INT(kJSON_ARRAY, docs.Type());
+    TEST_EQUAL(kLines, docs.GetArraySize());
+    for (int i = 0; i < docs.GetArraySize() && ok; ++i) {
+      ok = docs.GetArrayValue(i)->GetValueByKey("id", 2)->GetInt64() == i;
+    }
+
+    /* The callback can stop early. */
+    vector<int64_t> ids;
+    st = r.Parse(text.c_str(), text.size(), CollectId, &ids);
+    TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_HANDLER_ABORTED, st.Code());
+    TEST_EQUAL(5000u, ids.size());
+    for (size_t i = 0; i < ids.size() && ok; ++i) ok = (ids[i] == static_cast<int64_t>(i));
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+
+  /* The first bad line wins, wherever the chunks are. */
+  std::string bad = text + "{\"id\": 1,}\n" + text + "[\n";
+  NdjsonReader r(4);
+  Value docs;
+  JsonStatus st = r.Parse(bad.c_str(), bad.size(), docs);
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA, st.Code());
+  TEST_EQUAL(kLines + (kLines + 6) / 7 + 1, r.ErrorLine()); // blank lines count
+  TEST_EQUAL_INT(kJSON_NULL, docs.Type());
+  st = r.Parse("1\n2\n\n", 5, docs);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL(2, docs.GetArraySize());
+  TEST_EQUAL(0, r.ErrorLine());
+  st = r.Parse("", 0, docs);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL(0, docs.GetArraySize());
+}
+
+/* Parse @t with and without kPARSE_PARALLEL on 4 threads, into a Value and
+ * a Document, and check that all four agree. */
+bool SameAsSequential(const std::string& t, int flags, JsonStatus::Status* code = NULL) {
+  ParseContext ctx;
+  ctx.SetThreads(4);
+  int len = static_cast<int>(t.size());
+  Value seq, par;
+  Document seq_doc, par_doc;
+  JsonStatus s1 = seq.Parse(t.c_str(), len, flags);
+  JsonStatus s2 = par.Parse(ctx, t.c_str(), len, flags | kPARSE_PARALLEL);
+  JsonStatus s3 = seq_doc.Parse(t.c_str(), len, flags);
+  JsonStatus s4 = par_doc.Parse(ctx, t.c_str(), len, flags | kPARSE_PARALLEL);
+  if (code) *code = s1.Code();
+  if (s1 != s2 || s1 != s3 || s1 != s4) return false;
+  if (!s1.Ok()) return par.Type() == kJSON_NULL && par_doc.Type() == kJSON_NULL;
+  return Compare(&seq, &par) && Compare(&seq, &par_doc) && Compare(&seq, &seq_doc)
+         && seq.ToString() == par_doc.ToString();
+}
+
+void TestParallel() {
+  /* Records whose strings hold commas, brackets, quotes and backslashes, so
+   * that pieces start anywhere: inside strings, after escapes, deep in a
+   * record. */
+  std::string arr = "[";
+  const int kRecords = 80000;
+  for (int i = 0; i < kRecords; ++i) {
+    std::string n = std::to_string(i);
+    arr += (i ? ", " : " ");
+    arr += "{\"id\":" + n + ", \"s\":\"a,b]}{[\\\"" + n + "\\\\\", \"t\":[" + n + ", {\"u\":\"\\\\\\\\\"}, []]}";
+  }
+  arr += " ]\n";
+  bool ok = arr.size() > 4u * JSONUTIL_PARALLEL_PIECE_SIZE;
+  ok = ok && SameAsSequential(arr, kPARSE_DEFAULT);
+  ok = ok && SameAsSequential(arr, kPARSE_TWO_STAGE);
+  ok = ok && SameAsSequential(arr, kPARSE_ZERO_COPY);
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+
+  ParseContext ctx;
+  ctx.SetThreads(4);
+  Value v;
+  JsonStatus st = v.Parse(ctx, arr.c_str(), static_cast<int>(arr.size()), kPARSE_PARALLEL);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL(kRecords, v.GetArraySize());
+  bool in_order = true;
+  for (int i = 0; i < kRecords && in_order; ++i) {
+    in_order = v.GetArrayValue(i)->GetValueByKey("id", 2)->GetInt64() == i;
+  }
+  TEST_EQUAL_INT(true, in_order);
+
+  /* A root object, with duplicate keys in different pieces, and keys
+   * interned through a pool. */
+  std::string obj = "{";
+  for (int i = 0; i < 3 * kRecords; ++i) {
+    obj += (i ? ",\"k" : "\"k") + std::to_string(i % kRecords) + "\":[\"" + std::to_string(i)
+           + "\", {\"x\":\"],\\\"\"}, 1.5, true, null]";
+  }
+  obj += "}";
+  ok = SameAsSequential(obj, kPARSE_DEFAULT);
+  StringPool pool;
+  ParseContext pooled(&pool);
+  pooled.SetThreads(4);
+  Document doc;
+  st = doc.Parse(pooled, obj.c_str(), static_cast<int>(obj.size()), kPARSE_PARALLEL);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL(3 * kRecords, doc.GetObjectSize());
+  const Value* last = doc.GetValueByKey(Key("k7"));
+  ok = ok && last && last->GetArrayValue(0)->GetString() == std::to_string(2 * kRecords + 7)
+       && doc.GetObjectMember(0)->Key() == pool.Intern("k0", 2);
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+
+  /* Errors anywhere are those of the sequential parser. */
+  std::string body = arr.substr(0, arr.size() - 3);
+  size_t mid = body.size() / 2;
+  size_t cut = body.find(", {", mid);
+  const std::string bad[] = {
+    body + ", ]",
+    body.substr(0, cut) + ",," + body.substr(cut + 1) + "]",
+    body.substr(0, cut) + " 1 " + body.substr(cut) + "]",
+    body.substr(0, cut) + "]" + body.substr(cut) + "]",
+    body.substr(0, cut) + ", \"\\x\"" + body.substr(cut) + "]",
+    body.substr(0, cut) + ", \"open" + body.substr(cut) + "]",
+    body.substr(0, mid) + "\x01" + body.substr(mid) + "]",
+    body + "] x",
+    body,
+    "[" + body + "]]",
+    "[," + body.substr(1) + "]",
+    std::string(1, '[') + "1" + std::string(5 * JSONUTIL_PARALLEL_PIECE_SIZE, ' ') + "]",
+  };
+  const int kBad = 12;
+  int failed = 0;
+  for (int i = 0; i < kBad; ++i) {
+    JsonStatus::Status code = JsonStatus::kJSON_OK;
+    ok = SameAsSequential(bad[i], kPARSE_DEFAULT, &code) && SameAsSequential(bad[i], kPARSE_TWO_STAGE);
+    if (code != JsonStatus::kJSON_OK) ++failed;
+    TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok);
+  }
+  TEST_EQUAL(kBad - 2, failed); // "[" + body + "]]" and the padded array are valid
+
+  /* A root object whose piece ends in a member with no value. */
+  std::string members = obj.substr(0, obj.size() - 1);
+  std::string pad(3 * JSONUTIL_PARALLEL_PIECE_SIZE, ' ');
+  size_t at = members.find(",\"k", members.size() / 2);
+  const std::string bad_obj[] = {
+    members + ", \"bad\":" + pad + ", \"z\":1}",
+    members + ", \"bad\":" + pad + "}",
+    members + ", \"bad\"" + pad + "}",
+    members.substr(0, at) + ", \"bad\":" + pad + members.substr(at) + "}",
+  };
+  for (int i = 0; i < 4; ++i) {
+    JsonStatus::Status code = JsonStatus::kJSON_OK;
+    ok = SameAsSequential(bad_obj[i], kPARSE_TWO_STAGE, &code) && SameAsSequential(bad_obj[i], kPARSE_DEFAULT);
+    TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, ok && code != JsonStatus::kJSON_OK);
+  }
+}
+
+void TestValidate() {
+  /* The UTF-8 kernel at every offset, and cut off by the end. */
+  const char* valid[] = {
+    "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF",
+    "\xEF\xBF\xBF", "\xED\x9F\xBF", "\xC2\x80"
+  };
+  const char* invalid[] = {
+    "\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF",
+    "\xED\xA0\x80", "\xED\xBF\xBF", "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF",
+    "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xFF", "\xC3\x28",
+    "\xE2\x82\x28", "\xF0\x9F\x98\x28", "\xC3\xA9\xA9"
+  };
+  const char* cut[] = { "\xC3", "\xE2\x82", "\xF0\x9F\x98" };
+  bool ok = true;
+  for (int off = 0; off < 70; ++off) {
+    std::string pad(off, 'a');
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i) {
+      std::string t = pad + valid[i] + std::string(40, 'b');
+      ok = ok && IsValidUtf8(t.c_str(), t.c_str() + t.size());
+      ok = ok && IsValidUtf8(t.c_str(), t.c_str() + off + strlen(valid[i]));
+    }
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+      std::string t = pad + invalid[i] + std::string(40, 'b');
+      ok = ok && !IsValidUtf8(t.c_str(), t.c_str() + t.size());
+    }
+    for (size_t i = 0; i < sizeof(cut) / sizeof(cut[0]); ++i) {
+      std::string t = pad + cut[i];
+      ok = ok && !IsValidUtf8(t.c_str(), t.c_str() + t.size());
+    }
+  }
+  TEST_EQUAL_CHECK("-", SimdKernelName(), __func__, __LINE__, ok);
+
+  /* Validate() returns what Value::Parse does. */
+  std::string deep = std::string(JSONUTIL_PARSE_MAX_DEPTH + 1, '[');
+  std::string nested;
+  for (int i = 0; i < 100; ++i) nested += (i % 3) ? "[" : "{\"k\":";
+  nested += "1";
+  for (int i = 99; i >= 0; --i) nested += (i % 3) ? "]" : "}";
+  const char* texts[] = {
+    "null", " true ", "false", "-12.5e-3", "\"a\\\"b\\u00e9\\ud83d\\ude00\"",
+    "[]", "{ }", "[1,[2,[3,[]]],{\"k\":[true,null]}]",
+    "{\"b\": 1, \"a\": \"x\\ny\", \"c\": {\"d\": -0, \"e\": [1.5, 2]}}",
+    "\"caf\xC3\xA9\"", "{\"\xE2\x82\xAC\":\"\xF0\x9F\x98\x80\"}", nested.c_str(),
+    "", " ", "nul", "nulx", "truex", "-", "01", "1x", "1e400", "1e-400", "[1-2]",
+    "\"abc", "\"ab\\", "\"\\x\"", "\"\\u12\"", "\"\\ud800\"", "\"a\x01\"",
+    "[", "[1", "[1,", "[1,]", "[1 2", "[1\"a\"]", "{", "{1:2}", "{\"a\"",
+    "{\"a\" 1}", "{\"a\":", "{\"a\":1", "{\"a\":1,", "{\"a\":1,}", "{\"a\":1 \"b\"}",
+    "{\"a\":{}", "[[]", "[{}]]", "[1] x", "[[1,x]]", "{\"a\":[\"\\q\"]}", "1 2",
+    "]", "[}", "{]", deep.c_str(), "\"\xC3\"", "[\"\xED\xA0\x80\"]", "\xFF", "[1,\xC3\xA9]"
+  };
+  bool same = true;
+  for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); ++i) {
+    int len = static_cast<int>(strlen(texts[i]));
+    Value val;
+    JsonStatus ans = val.Parse(texts[i], len, kPARSE_VALIDATE_UTF8);
+    JsonStatus res = Validate(texts[i], len);
+    if (ans.Code() != res.Code()) {
+      same = false;
+      std::cout << texts[i] << ": " << ans.ToString() << " vs " << res.ToString() << std::endl;
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+
+  /* The check is opt-in for Parse, and comes before the grammar. */
+  const char bad_str[] = "[\"ab\xC0\xAF\"]";
+  int bad_len = static_cast<int>(strlen(bad_str));
+  Value val;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, val.Parse(bad_str, bad_len).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_INVALID_UTF8,
+                 val.Parse(bad_str, bad_len, kPARSE_VALIDATE_UTF8).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_INVALID_UTF8, Validate(bad_str, bad_len).Code());
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_INVALID_UTF8, Validate("[\xFF", 2).Code());
+  Document doc;
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_INVALID_UTF8,
+                 doc.Parse(bad_str, bad_len, kPARSE_VALIDATE_UTF8 | kPARSE_TWO_STAGE).Code());
+  JsonStatus st(JsonStatus::kJSON_PARSE_INVALID_UTF8);
+  TEST_EQUAL(std::string("Json parse invalid utf8"), st.ToString());
+
+  /* The writer escapes code points, and malformed bytes as U+FFFD. */
+  const char raw[] = "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\xEF\xBF\xBF|\xC0\xAF|\xED\xA0\x80|\xE2\x82";
+  val.SetString(raw, static_cast<int>(strlen(raw)));
+  TEST_EQUAL(std::string("\"\\u00E9\\u20AC\\uD83D\\uDE00\\uFFFF|\\uFFFD\\uFFFD|"
+                         "\\uFFFD\\uFFFD\\uFFFD|\\uFFFD\\uFFFD\""),
+             std::string(val.ToString().c_str()));
+  Value back;
+  std::string out = val.ToString();
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK,
+                 back.Parse(out.c_str(), static_cast<int>(out.size()), kPARSE_VALIDATE_UTF8).Code());
+}
+
+/* Collects the chunks of Writer::WriteTo; stops after @limit of them. */
+struct ChunkSink {
+  std::string text;
+  int chunks;
+  int limit;
+  bool even; // every chunk but the last had the full size
+  int size;
+};
+
+bool CollectChunk(const char* data, int len, void* arg) {
+  ChunkSink* sink = static_cast<ChunkSink*>(arg);
+  if (sink->chunks > 0 && static_cast<int>(sink->text.size()) % sink->size != 0) {
+    sink->even = false;
+  }
+  sink->text.append(data, len);
+  return ++sink->chunks < sink->limit;
+}
+
+void TestWriter() {
+  std::string big = std::string(1234, 'x') + "\\n" + std::string(4000, 'y');
+  std::string text = "{\"a\\\"b\": [1, -2, 18446744073709551615, 0.5, true, false, null],"
+                     " \"esc\": \"t\\tq\\\"s\\/\\u0001\\u00e9\\ud83d\\ude00\","
+                     " \"nest\": [[], {}, [{\"k\": [\"v\"]}]], \"big\": \"" + big + "\"}";
+  Value val;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, val.Parse(text.c_str(), static_cast<int>(text.size())).Code());
+  std::string ans(val.ToString().c_str());
+  /* Keys are escaped like strings. */
+  bool key = ans.compare(0, 8, "{\"a\\\"b\":") == 0;
+  TEST_EQUAL_INT(true, key);
+  Value back;
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, back.Parse(ans.c_str(), static_cast<int>(ans.size())).Code());
+  bool equal = Compare(&val, &back);
+  TEST_EQUAL_INT(true, equal);
+
+  /* Any buffer size gives the same text, resumed wherever it stopped. */
+  const int caps[] = { 1, 2, 3, 5, 7, 11, 13, 64, 4096, 100000 };
+  bool same = true;
+  for (size_t i = 0; i < sizeof(caps) / sizeof(caps[0]); ++i) {
+    Writer w(val);
+    std::string out;
+    char buf[100000];
+    int n = 0;
+    while ((n = w.Write(buf, caps[i])) == caps[i]) out.append(buf, n);
+    out.append(buf, n);
+    if (out != ans || !w.Done() || w.Write(buf, caps[i]) != 0) {
+      same = false;
+      std::cout << "cap " << caps[i] << ": " << out << std::endl;
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+  Value scalar;
+  scalar.SetString("a\"b", 3);
+  Writer ws(scalar);
+  char small[8];
+  int n1 = ws.Write(small, 3);
+  int n2 = ws.Write(small + n1, 5);
+  TEST_EQUAL_INT(3, n1);
+  TEST_EQUAL_INT(3, n2);
+  TEST_EQUAL(std::string("\"a\\\"b\""), std::string(small, n1 + n2));
+
+  /* A growable buffer, reused by the next write. */
+  Stack out;
+  Writer w(val);
+  w.WriteTo(out);
+  TEST_EQUAL(ans, std::string(out.Dump(), out.Top()));
+  int size = out.Size();
+  out.Pop(out.Top());
+  w.Reset(val);
+  w.WriteTo(out);
+  TEST_EQUAL(ans, std::string(out.Dump(), out.Top()));
+  TEST_EQUAL_INT(size, out.Size());
+
+  /* Fixed-size chunks through a callback, which may stop the write. */
+  ChunkSink sink = { "", 0, 1 << 30, true, 100 };
+  w.Reset(val);
+  JsonStatus st = w.WriteTo(CollectChunk, &sink, 100);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  TEST_EQUAL(ans, sink.text);
+  TEST_EQUAL_INT(static_cast<int>((ans.size() + 99) / 100), sink.chunks);
+  TEST_EQUAL_INT(true, sink.even);
+  ChunkSink stop = { "", 0, 2, true, 100 };
+  w.Reset(val);
+  st = w.WriteTo(CollectChunk, &stop, 100);
+  TEST_EQUAL_INT(JsonStatus::kJSON_WRITE_ABORTED, st.Code());
+  TEST_EQUAL_INT(200, static_cast<int>(stop.text.size()));
+  TEST_EQUAL_INT(false, w.Done());
+
+  /* A file descriptor. */
+  std::string path = WriteTempFile("");
+  int fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+  w.Reset(val);
+  st = w.WriteTo(fd, 7);
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  close(fd);
+  Document doc;
+  st = doc.ParseFile(path.c_str());
+  TEST_EQUAL_INT(JsonStatus::kJSON_OK, st.Code());
+  equal = Compare(&val, &doc);
+  TEST_EQUAL_INT(true, equal);
+  unlink(path.c_str());
+  w.Reset(val);
+  st = w.WriteTo(-1);
+  TEST_EQUAL_INT(JsonStatus::kJSON_FILE_IO_ERROR, st.Code());
+}
+
+void TestWriteDouble() {
+  /* Shortest digits, plain decimals where short enough. */
+  const double nums[] = {
+    0.1, 0.3, -1.5, 100.0, -2500.0, 1e21, 1e22, 1.234e-5, 1e-6, 1e-7, 0.0, -0.0,
+    5e-324, 1.7976931348623157e308, 2.2250738585072014e-308, 9007199254740993.0,
+    123456789012345678.0, 3.14159e200
+  };
+  const char* texts[] = {
+    "0.1", "0.3", "-1.5", "100", "-2500", "1e21", "1e22", "0.00001234", "0.000001",
+    "1e-7", "0", "-0", "5e-324", "1.7976931348623157e308", "2.2250738585072014e-308",
+    "9007199254740992", "123456789012345680", "3.14159e200"
+  };
+  for (size_t i = 0; i < sizeof(nums) / sizeof(nums[0]); ++i) {
+    Value val;
+    val.SetNumber(nums[i]);
+    TEST_EQUAL(std::string(texts[i]), std::string(val.ToString().c_str()));
+  }
+  Value nan;
+  nan.SetNumber(strtod("nan", NULL));
+  TEST_EQUAL(std::string("null"), std::string(nan.ToString().c_str()));
+
+  /* Everything reads back as the same double. */
+  bool same = true;
+  uint64_t u = 0x9E3779B97F4A7C15ULL;
+  for (int i = 0; i < 200000; ++i) {
+    u ^= u << 13;
+    u ^= u >> 7;
+    u ^= u << 17;
+    double d = 0.0;
+    memcpy(&d, &u, sizeof(d));
+    if (d != d || d - d != 0.0) continue;
+    Value val, back;
+    val.SetNumber(d);
+    std::string out(val.ToString().c_str());
+    JsonStatus st = back.Parse(out.c_str(), static_cast<int>(out.size()));
+    if (!st.Ok() || back.GetNumber() != d) {
+      same = false;
+      std::cout << out << std::endl;
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+}
+
+void TestDepth() {
+  /* Every parser stops at the same depth. */
+  const int kMax = JSONUTIL_PARSE_MAX_DEPTH;
+  std::string ok_arr = std::string(kMax, '[') + std::string(kMax, ']');
+  std::string deep_arr = std::string(kMax + 1, '[') + std::string(kMax + 1, ']');
+  std::string ok_obj, deep_obj;
+  for (int i = 0; i < kMax; ++i) ok_obj += "{\"k\":";
+  ok_obj += "1" + std::string(kMax, '}');
+  deep_obj = "[" + ok_obj + "]";
+  const std::string* texts[] = { &ok_arr, &deep_arr, &ok_obj, &deep_obj };
+  bool same = true;
+  for (int i = 0; i < 4; ++i) {
+    const std::string& t = *texts[i];
+    int len = static_cast<int>(t.size());
+    JsonStatus::Status ans = (i % 2) ? JsonStatus::kJSON_PARSE_MAX_DEPTH_EXCEEDED
+                                     : JsonStatus::kJSON_OK;
+    Value val;
+    Document doc;
+    Reader r;
+    CountHandler h;
+    Value res;
+    ValueHandler vh(res);
+    PushParser<ValueHandler> pp(vh);
+    JsonStatus s1 = val.Parse(t.c_str(), len);
+    JsonStatus s2 = doc.Parse(t.c_str(), len, kPARSE_TWO_STAGE);
+    JsonStatus s3 = r.Parse(t.c_str(), len, h);
+    JsonStatus s4 = PushImpl(pp, t, 7);
+    if (s1.Code() != ans || s2.Code() != ans || s3.Code() != ans || s4.Code() != ans) {
+      same = false;
+      std::cout << i << ": " << s1.ToString() << ", " << s2.ToString() << ", "
+                << s3.ToString() << ", " << s4.ToString() << std::endl;
+    }
+  }
+  TEST_EQUAL_CHECK("-", "-", __func__, __LINE__, same);
+  std::string bad = std::string(kMax + 1, '[') + "x";
+  Value val;
+  JsonStatus st = val.Parse(bad.c_str(), static_cast<int>(bad.size()), kPARSE_TWO_STAGE);
+  TEST_EQUAL_INT(JsonStatus::kJSON_PARSE_MAX_DEPTH_EXCEEDED, st.Code());
+
+  /* Trees far deeper than the parse limit can still be written, compared
+   * and freed. */
+  const int kDeep = 200000;
+  Value deep;
+  {
+    ValueHandler vh(deep);
+    for (int i = 0; i < kDeep; ++i) vh.StartArray();
+    vh.Null();
+    for (int i = 0; i < kDeep; ++i) vh.EndArray(1);
+  }
+  std::string out = deep.ToString();
+  TEST_EQUAL_INT(2 * kDeep + 4, static_cast<int>(strlen(out.c_str())));
+  bool shape = out.compare(0, 3, "[[[") == 0 && out.compare(kDeep, 4, "null") == 0;
+  TEST_EQUAL_INT(true, shape);
+  bool equal = Compare(&deep, &deep);
+  TEST_EQUAL_INT(true, equal);
+  deep.Reset();
+  TEST_EQUAL_INT(kJSON_NULL, deep.Type());
+}
+
 void Test() {
   TestParseNull();
   TestParseFalse();
   TestParseTrue();
   TestParseNotSingular();
   TestParseNumber();
+  TestInt64();
   TestSetterAndGetter();
   TestParseString();
+  TestInlineString();
   TestParseArray();
   TestParseObject();
+  TestObjectOrder();
+  TestObjectIndex();
+  TestKey();
+  TestCompactLayout();
+  TestStringPool();
+  TestDocument();
+  TestParseInsitu();
+  TestParseZeroCopy();
+  TestParseFile();
+  TestParseContext();
+  TestSimdScan();
+  TestTwoStage();
+  TestTape();
+  TestLazy();
+  TestDepth();
+  TestReader();
+  TestPushParser();
+  TestNdjson();
+  TestParallel();
+  TestValidate();
+  TestWriter();
+  TestWriteDouble();
   TestJsonStringify();
   TestSerialize();
 }
@@ -0,0 +1,123 @@
+#include "validate.h"
+#include "simd.h"
+#include "slice.h"
+#include "number.h"
+#include "decode.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace jsonutil {
+
+namespace {
+
+/* The first byte of the next token, '\0' past the last one. */
+inline char Peek(Slice& s) {
+  const char* p = SkipWhitespace(s.Ptr(), s.Ptr() + s.Len());
+  s.Move(static_cast<int>(p - s.Ptr()));
+  return s.Len() ? *(s.Ptr()) : '\0';
+}
+
+JsonStatus CheckLiteral(Slice& s, char c) {
+  const char* word = (c == 'n') ? "null" : (c == 't') ? "true" : "false";
+  int n = (c == 'f') ? 5 : 4;
+  if (s.Len() < n || memcmp(s.Ptr(), word, n) != 0) {
+    return JsonStatus::kJSON_PARSE_INVALID_VALUE;
+  }
+  s.Move(n);
+  return JsonStatus::kJSON_OK;
+}
+
+JsonStatus CheckScalar(Slice& s, char c) {
+  Number num;
+  switch (c) {
+    case 'n':  // fall through
+    case 'f':  // fall through
+    case 't':  return CheckLiteral(s, c);
+    case '\"': return SkipString(s);
+    case '\0': return JsonStatus::kJSON_PARSE_EXPECT_VALUE;
+    default:   return ScanNumber(s, num);
+  }
+}
+
+/* The key and the colon of the next member. */
+JsonStatus CheckKey(Slice& s) {
+  if (Peek(s) != '\"') return JsonStatus::kJSON_PARSE_OBJECT_MISSING_KEY;
+  JsonStatus ret = SkipString(s);
+  if (ret != JsonStatus::kJSON_OK) return ret;
+  if (Peek(s) != ':') return JsonStatus::kJSON_PARSE_OBJECT_MISSING_COLON;
+  s.Move(1);
+  return ret;
+}
+
+/* Value::ParseTree without the tree: the open containers are only told
+ * apart by one bit each, in @objects. */
+JsonStatus CheckGrammar(Slice& s) {
+  uint64_t objects[JSONUTIL_PARSE_MAX_DEPTH / 64 + 1];
+  int depth = 0;
+  bool object = false; // the innermost container is an object
+  JsonStatus ret;
+  while (true) {
+    char c = Peek(s);
+    if (c == '[' || c == '{') {
+      if (depth == JSONUTIL_PARSE_MAX_DEPTH) {
+        return JsonStatus::kJSON_PARSE_MAX_DEPTH_EXCEEDED;
+      }
+      s.Move(1);
+      object = (c == '{');
+      uint64_t bit = 1ULL << (depth % 64);
+      if (object) {
+        objects[depth / 64] |= bit;
+      } else {
+        objects[depth / 64] &= ~bit;
+      }
+      ++depth;
+      if (Peek(s) != (object ? '}' : ']')) {
+        if (object && (ret = CheckKey(s)) != JsonStatus::kJSON_OK) return ret;
+        continue;
+      }
+      s.Move(1);
+      --depth;
+    } else {
+      ret = CheckScalar(s, c);
+      if (ret != JsonStatus::kJSON_OK) return ret;
+    }
+
+    /* A value is complete: close the containers that end right after it. */
+    while (depth > 0) {
+      object = ((objects[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1) != 0;
+      char close = object ? '}' : ']';
+      c = Peek(s);
+      if (c == ',') {
+        s.Move(1);
+        if (Peek(s) == close) {
+          return object ? JsonStatus::kJSON_PARSE_OBJECT_INVALID_EXTRA_COMMA
+                        : JsonStatus::kJSON_PARSE_ARRAY_INVALID_EXTRA_COMMA;
+        }
+        if (object && (ret = CheckKey(s)) != JsonStatus::kJSON_OK) return ret;
+        break;
+      }
+      if (c != close) {
+        return object ? JsonStatus::kJSON_PARSE_OBJECT_MISSING_COMMA_OR_CURLY_BRACKET
+                      : JsonStatus::kJSON_PARSE_ARRAY_MISSING_COMMA;
+      }
+      s.Move(1);
+      --depth;
+    }
+    if (depth == 0) break;
+  }
+  return Peek(s) == '\0' ? JsonStatus::kJSON_OK
+                         : JsonStatus::kJSON_PARSE_ROOT_NOT_SINGULAR;
+}
+
+} // static-function namespace
+
+JsonStatus Validate(const char* text, int len) {
+  assert(text != NULL && len >= 0);
+  if (!IsValidUtf8(text, text + len)) return JsonStatus::kJSON_PARSE_INVALID_UTF8;
+  Slice s(text, len);
+  return CheckGrammar(s);
+}
+
+} // namespace jsonutil
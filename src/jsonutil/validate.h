@@ -0,0 +1,16 @@
+#ifndef JSONUTIL_SRC_VALIDATE_H__
+#define JSONUTIL_SRC_VALIDATE_H__
+
+#include "json_status.h"
+
+namespace jsonutil {
+/* Checks that [text, text + len) is one well-formed JSON document in valid
+ * UTF-8, without building anything: the status is the one Value::Parse
+ * returns with kPARSE_VALIDATE_UTF8, kJSON_OK included. The UTF-8 of the
+ * whole input is checked first, so kJSON_PARSE_INVALID_UTF8 wins over any
+ * grammar error. Nothing is allocated, except that numbers of 64 or more
+ * characters which need an exact slow conversion take a heap copy. */
+JsonStatus Validate(const char* text, int len);
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_VALIDATE_H__
@@ -0,0 +1,386 @@
+#include "writer.h"
+#include "number.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace jsonutil {
+
+namespace {
+
+/* A container being written, and the child being written. */
+struct WriteFrame {
+  const Value* v;
+  int index;
+};
+
+int ChildCount(const Value* v) {
+  if (v->Type() == kJSON_ARRAY) return v->GetArraySize();
+  if (v->Type() == kJSON_OBJECT) return v->GetObjectSize();
+  return 0;
+}
+
+const char kDigitPairs[201] =
+  "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+  "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+/* Writes @u backwards ending at @end, two digits at a time, and returns
+ * the first byte written. */
+char* WriteUint64Backward(char* end, uint64_t u) {
+  while (u >= 100) {
+    const char* d = kDigitPairs + (u % 100) * 2;
+    u /= 100;
+    *--end = d[1];
+    *--end = d[0];
+  }
+  if (u >= 10) {
+    const char* d = kDigitPairs + u * 2;
+    *--end = d[1];
+    *--end = d[0];
+  } else {
+    *--end = static_cast<char>('0' + u);
+  }
+  return end;
+}
+
+char* WriteInt64Backward(char* end, int64_t i) {
+  /* 0 - u keeps INT64_MIN well-defined. */
+  char* p = WriteUint64Backward(end, i < 0 ? 0 - static_cast<uint64_t>(i)
+                                           : static_cast<uint64_t>(i));
+  if (i < 0) *--p = '-';
+  return p;
+}
+
+/* The shortest text that reads back as the same double. Integral values
+ * below 2^53 take the integer path; NaN and infinities, which JSON cannot
+ * hold, are written as null. @buf holds 32 bytes. */
+int NumberToString(char* buf, const Value* v) {
+  double d = v->GetNumber();
+  if (d != d || d - d != 0.0) {
+    memcpy(buf, "null", 4);
+    return 4;
+  }
+  if (d > -9007199254740992.0 && d < 9007199254740992.0 && d != 0.0
+      && d == static_cast<double>(static_cast<int64_t>(d))) {
+    char* end = buf + 32;
+    char* p = WriteInt64Backward(end, static_cast<int64_t>(d));
+    int len = static_cast<int>(end - p);
+    memmove(buf, p, len);
+    return len;
+  }
+  return WriteDouble(d, buf);
+}
+
+/* Writes the integer @v so that it ends at @end; returns its first byte. */
+char* IntegerToString(char* end, const Value* v) {
+  if (v->Type() == kJSON_UINT64) return WriteUint64Backward(end, v->GetUint64());
+  return WriteInt64Backward(end, v->GetInt64());
+}
+
+/* Decodes the sequence at @p, whose first byte is 0x80 or above, and sets
+ * @bytes to its length. A malformed sequence, or one cut off by @end, reads
+ * as U+FFFD (the replacement character) over one byte. */
+uint32_t DecodeUTF8(const char* p, const char* end, int* bytes) {
+  const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+  uint32_t codepoint = 0;
+  uint32_t min = 0; // the smallest code point that needs this length
+  int n = 0;
+  if ((u[0] & 0xE0) == 0xC0) {
+    n = 2;
+    codepoint = u[0] & 0x1F;
+    min = 0x80;
+  } else if ((u[0] & 0xF0) == 0xE0) {
+    n = 3;
+    codepoint = u[0] & 0x0F;
+    min = 0x800;
+  } else if ((u[0] & 0xF8) == 0xF0) {
+    n = 4;
+    codepoint = u[0] & 0x07;
+    min = 0x10000;
+  }
+  *bytes = 1;
+  if (n == 0 || end - p < n) return 0xFFFD;
+  for (int i = 1; i < n; ++i) {
+    if ((u[i] & 0xC0) != 0x80) return 0xFFFD;
+    codepoint = (codepoint << 6) | (u[i] & 0x3F);
+  }
+  if (codepoint < min || codepoint > 0x10FFFF
+      || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+    return 0xFFFD;
+  }
+  *bytes = n;
+  return codepoint;
+}
+
+/* Bytes of a string that are written as they are. */
+inline bool IsPlain(unsigned char c) {
+  return c >= 0x20 && c < 0x80 && c != '\"' && c != '\\' && c != '/';
+}
+
+/* Writes "\uXXXX" for @u to @out. */
+void WriteHex(char* out, uint32_t u) {
+  static const char kHex[] = "0123456789ABCDEF";
+  out[0] = '\\';
+  out[1] = 'u';
+  for (int i = 5; i >= 2; --i) {
+    out[i] = kHex[u & 0xF];
+    u >>= 4;
+  }
+}
+
+/* Escapes the byte or UTF-8 sequence at @s, which is not plain, into @out;
+ * returns the bytes written, at most 12, and sets @step to those of @s. */
+int Escape(const char* s, const char* end, char* out, int& step) {
+  unsigned char c = static_cast<unsigned char>(*s);
+  step = 1;
+  out[0] = '\\';
+  switch (c) {
+    case '\\': out[1] = '\\'; return 2;
+    case '\"': out[1] = '\"'; return 2;
+    case '\b': out[1] = 'b';  return 2;
+    case '\f': out[1] = 'f';  return 2;
+    case '\n': out[1] = 'n';  return 2;
+    case '\r': out[1] = 'r';  return 2;
+    case '\t': out[1] = 't';  return 2;
+    case '/':  out[1] = '/';  return 2;
+    default:   break;
+  }
+  if (c < 0x20) {
+    WriteHex(out, c);
+    return 6;
+  }
+  uint32_t codepoint = DecodeUTF8(s, end, &step);
+  if (codepoint < 0x10000) {
+    WriteHex(out, codepoint);
+    return 6;
+  }
+  /* A surrogate pair. */
+  codepoint -= 0x10000;
+  WriteHex(out, 0xD800 + (codepoint >> 10));
+  WriteHex(out + 6, 0xDC00 + (codepoint & 0x3FF));
+  return 12;
+}
+
+} // static-function namespace
+
+Writer::Writer()
+  : state_(kDONE), cur_(NULL), str_(NULL), len_(0), pos_(0), key_(false),
+    pending_(0), pend_pos_(0) {
+}
+
+Writer::Writer(const Value& v)
+  : state_(kVALUE), cur_(&v), str_(NULL), len_(0), pos_(0), key_(false),
+    pending_(0), pend_pos_(0) {
+}
+
+void Writer::Reset(const Value& v) {
+  state_ = kVALUE;
+  cur_ = &v;
+  str_ = NULL;
+  len_ = pos_ = 0;
+  key_ = false;
+  path_.Pop(path_.Top());
+  pending_ = pend_pos_ = 0;
+}
+
+/* Copies what fits of @s to [p, end) and keeps the rest for the next
+ * Write(); a token never goes before the end of an earlier one. */
+char* Writer::Put(char* p, char* end, const char* s, int len) {
+  int n = 0;
+  if (pending_ == 0) {
+    n = (end - p < len) ? static_cast<int>(end - p) : len;
+    memcpy(p, s, n);
+    p += n;
+  }
+  assert(pending_ + len - n <= static_cast<int>(sizeof(pend_)));
+  memcpy(pend_ + pending_, s + n, len - n);
+  pending_ += len - n;
+  return p;
+}
+
+/* The first bytes of @cur_: a whole scalar, or what opens a string or a
+ * container. */
+char* Writer::PutValue(char* p, char* end) {
+  char buf[32];
+  char* num = NULL;
+  int len = 0;
+  state_ = kNEXT;
+  switch (cur_->Type()) {
+    case kJSON_NULL:   return Put(p, end, "null", 4);
+    case kJSON_FALSE:  return Put(p, end, "false", 5);
+    case kJSON_TRUE:   return Put(p, end, "true", 4);
+    case kJSON_NUMBER: len = NumberToString(buf, cur_);
+                       return Put(p, end, buf, len);
+    case kJSON_INT64:  // fall through
+    case kJSON_UINT64: num = IntegerToString(buf + sizeof(buf), cur_);
+                       return Put(p, end, num, static_cast<int>(buf + sizeof(buf) - num));
+    case kJSON_STRING: state_ = kSTRING;
+                       str_ = cur_->GetString();
+                       len_ = cur_->GetStringLength();
+                       pos_ = 0;
+                       key_ = false;
+                       return Put(p, end, "\"", 1);
+    default:           break;
+  }
+  bool array = (cur_->Type() == kJSON_ARRAY);
+  if (ChildCount(cur_) == 0) return Put(p, end, array ? "[]" : "{}", 2);
+  WriteFrame f;
+  f.v = cur_;
+  f.index = 0;
+  memcpy(path_.Push(sizeof(f)), &f, sizeof(f));
+  p = Put(p, end, array ? "[" : "{", 1);
+  return EnterChild(p, end, f.v, 0);
+}
+
+/* Escapes @str_ from @pos_ on, as far as [p, end) goes. */
+char* Writer::PutString(char* p, char* end) {
+  const char* s = str_ + pos_;
+  const char* send = str_ + len_;
+  while (s < send && p < end) {
+    const char* limit = (end - p < send - s) ? s + (end - p) : send;
+    const char* q = s;
+    while (q < limit && IsPlain(static_cast<unsigned char>(*q))) ++q;
+    memcpy(p, s, q - s);
+    p += q - s;
+    s = q;
+    if (q == limit) continue;
+    char esc[12];
+    int step = 0;
+    int n = Escape(s, send, esc, step);
+    p = Put(p, end, esc, n);
+    s += step;
+  }
+  pos_ = static_cast<int>(s - str_);
+  if (s < send) return p;
+  if (key_) {
+    state_ = kVALUE;
+    return Put(p, end, "\":", 2);
+  }
+  state_ = kNEXT;
+  return Put(p, end, "\"", 1);
+}
+
+/* After a complete value: the next child of the innermost container, or
+ * the bracket that closes it. */
+char* Writer::PutNext(char* p, char* end) {
+  if (path_.Top() == 0) {
+    state_ = kDONE;
+    return p;
+  }
+  WriteFrame f;
+  memcpy(&f, path_.Pop(sizeof(f)), sizeof(f));
+  if (++f.index < ChildCount(f.v)) {
+    memcpy(path_.Push(sizeof(f)), &f, sizeof(f));
+    p = Put(p, end, ",", 1);
+    return EnterChild(p, end, f.v, f.index);
+  }
+  return Put(p, end, f.v->Type() == kJSON_ARRAY ? "]" : "}", 1);
+}
+
+/* Makes the @index-th child of @v the next to write; in an object, its
+ * key comes first. */
+char* Writer::EnterChild(char* p, char* end, const Value* v, int index) {
+  if (v->Type() == kJSON_ARRAY) {
+    cur_ = v->GetArrayValue(index);
+    state_ = kVALUE;
+    return p;
+  }
+  const Member* m = v->GetObjectMember(index);
+  cur_ = m->Val();
+  str_ = m->Key();
+  len_ = m->KLen();
+  pos_ = 0;
+  key_ = true;
+  state_ = kSTRING;
+  return Put(p, end, "\"", 1);
+}
+
+int Writer::Write(char* buf, int cap) {
+  assert(cap >= 0 && (buf != NULL || cap == 0));
+  char* p = buf;
+  char* end = buf + cap;
+  if (pending_ > 0) {
+    int n = (pending_ - pend_pos_ < cap) ? pending_ - pend_pos_ : cap;
+    memcpy(p, pend_ + pend_pos_, n);
+    p += n;
+    pend_pos_ += n;
+    if (pend_pos_ < pending_) return cap;
+    pending_ = pend_pos_ = 0;
+  }
+  while (p < end) {
+    switch (state_) {
+      case kVALUE:  p = PutValue(p, end);  break;
+      case kSTRING: p = PutString(p, end); break;
+      case kNEXT:   p = PutNext(p, end);   break;
+      default:      return static_cast<int>(p - buf);
+    }
+  }
+  return cap;
+}
+
+void Writer::WriteTo(Stack& out) {
+  while (!Done()) {
+    /* The free space of @out first, then room as the stack grows. */
+    int room = out.Size() - out.Top();
+    if (room < JSONUTIL_WRITE_CHUNK_SIZE) room = JSONUTIL_WRITE_CHUNK_SIZE;
+    char* dst = out.Push(room);
+    out.Pop(room - Write(dst, room));
+  }
+}
+
+JsonStatus Writer::WriteTo(WriteCallback cb, void* arg, int chunk) {
+  assert(cb != NULL && chunk > 0);
+  if (Done()) return JsonStatus::kJSON_OK;
+  char* buf = static_cast<char*>(malloc(chunk));
+  if (buf == NULL) return JsonStatus::kJSON_OUT_OF_MEMORY;
+  JsonStatus ret;
+  while (!Done()) {
+    int n = Write(buf, chunk);
+    if (n > 0 && !cb(buf, n, arg)) {
+      ret = JsonStatus::kJSON_WRITE_ABORTED;
+      break;
+    }
+  }
+  free(buf);
+  return ret;
+}
+
+namespace {
+
+struct FdSink {
+  int fd;
+  bool failed;
+};
+
+/* Retries short writes and EINTR. */
+bool WriteFd(const char* data, int len, void* arg) {
+  FdSink* sink = static_cast<FdSink*>(arg);
+  while (len > 0) {
+    ssize_t n = write(sink->fd, data, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      sink->failed = true;
+      return false;
+    }
+    data += n;
+    len -= static_cast<int>(n);
+  }
+  return true;
+}
+
+} // static-function namespace
+
+JsonStatus Writer::WriteTo(int fd, int chunk) {
+  FdSink sink;
+  sink.fd = fd;
+  sink.failed = false;
+  JsonStatus ret = WriteTo(WriteFd, &sink, chunk);
+  return sink.failed ? JsonStatus::kJSON_FILE_IO_ERROR : ret;
+}
+
+} // namespace jsonutil
@@ -0,0 +1,70 @@
+#ifndef JSONUTIL_SRC_WRITER_H__
+#define JSONUTIL_SRC_WRITER_H__
+
+#include "json.h"
+#include "stack.h"
+#include "json_status.h"
+
+/* Chunk size of Writer::WriteTo with a callback or a file descriptor. */
+#ifndef JSONUTIL_WRITE_CHUNK_SIZE
+  #define JSONUTIL_WRITE_CHUNK_SIZE (64 << 10)
+#endif
+
+namespace jsonutil {
+/* Called with each chunk of the text; return false to stop the write with
+ * kJSON_WRITE_ABORTED. */
+typedef bool (*WriteCallback)(const char* data, int len, void* arg);
+
+/* Writes a Value as JSON text, the same text as Value::ToString() without
+ * its trailing '\0', straight into memory or a sink of the caller: the text
+ * is never held whole. A write can stop at any byte and resume on the next
+ * call. The value must not change until the text is complete. */
+class Writer {
+ public:
+  Writer();
+  explicit Writer(const Value& v);
+
+  /* Start over on @v, keeping the memory of the previous walk. */
+  void Reset(const Value& v);
+  /* Writes the next bytes of the text into @buf, at most @cap of them, and
+   * returns how many. Fewer than @cap means the text is complete. */
+  int Write(char* buf, int cap);
+  bool Done() const { return state_ == kDONE && pending_ == 0; }
+
+  /* The rest of the text is appended to @out, so that a buffer kept by the
+   * caller is reused across calls. */
+  void WriteTo(Stack& out);
+  /* The rest of the text goes to @cb in chunks of @chunk bytes, the last one
+   * possibly shorter. */
+  JsonStatus WriteTo(WriteCallback cb, void* arg, int chunk = JSONUTIL_WRITE_CHUNK_SIZE);
+  /* As above, to the file descriptor @fd. Fails with kJSON_FILE_IO_ERROR if
+   * write(2) does; the bytes written so far stay written. */
+  JsonStatus WriteTo(int fd, int chunk = JSONUTIL_WRITE_CHUNK_SIZE);
+
+ private:
+  /* Writer is noncopyable. */
+  Writer(const Writer&);
+  const Writer& operator=(const Writer&);
+
+  enum { kVALUE, kSTRING, kNEXT, kDONE };
+
+  char* Put(char* p, char* end, const char* s, int len);
+  char* PutValue(char* p, char* end);
+  char* PutString(char* p, char* end);
+  char* PutNext(char* p, char* end);
+  char* EnterChild(char* p, char* end, const Value* v, int index);
+
+  int state_;
+  const Value* cur_;   /* kVALUE: the value to write next */
+  const char* str_;    /* kSTRING: the string or key being escaped */
+  int len_;
+  int pos_;            /* bytes of @str_ written */
+  bool key_;           /* @str_ is the key of @cur_ */
+  Stack path_;         /* the containers being written */
+  char pend_[64];      /* the end of a token that did not fit */
+  int pending_;
+  int pend_pos_;
+};
+
+} // namespace jsonutil
+#endif // JSONUTIL_SRC_WRITER_H__